@@ -0,0 +1,587 @@
+/*
+  ==============================================================================
+
+    Multichannel biquad cascade that runs every channel in one pass.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <utility>
+#include <vector>
+
+//plain-value biquad coefficients, stored normalised as b0, b1, b2, a1, a2 (the same layout juce's IIR::Coefficients uses)
+using BiquadCoefficients = std::array<float, 5>;
+
+//time-domain kernel for a single channel: works out N = numLanes outputs per step instead of one
+//the biquad recurrence is unrolled over the block (a block state-space / look-ahead form), so
+//  y[0..N-1] = P * s1 + Q * s2 + sum_j T_j * x[j]
+//where P, Q are the block's response to the two state values and T_j its response to an impulse at j.
+//all of those are plain vectors, so a step is N + 2 multiply-adds across lanes, and the new state
+//falls out of the last two outputs exactly like transposed direct form II would produce it
+struct BlockBiquadKernel
+{
+    using Vec = juce::dsp::SIMDRegister<float>;
+    static constexpr int blockSize = (int)Vec::SIMDNumElements;
+    static_assert(blockSize >= 2, "the state update needs the last two outputs of a step");
+
+    void setCoefficients(const BiquadCoefficients& newCoefficients)
+    {
+        coefficients = newCoefficients;
+
+        //run the scalar recurrence on each basis input, in double so the matrices are as exact as we can make them
+        auto respond = [this](double s1, double s2, int impulseAt, int lane)
+        {
+            const auto& c = coefficients;
+            double y = 0;
+
+            for (int i = 0; i <= lane; ++i)
+            {
+                const double x = (i == impulseAt) ? 1.0 : 0.0;
+                y = c[0] * x + s1;
+                s1 = c[1] * x - c[3] * y + s2;
+                s2 = c[2] * x - c[4] * y;
+            }
+
+            return (float)y;
+        };
+
+        std::array<float, blockSize> p{}, q{};
+        for (int lane = 0; lane < blockSize; ++lane)
+        {
+            p[(size_t)lane] = respond(1.0, 0.0, -1, lane);
+            q[(size_t)lane] = respond(0.0, 1.0, -1, lane);
+        }
+        stateResponse1 = load(p);
+        stateResponse2 = load(q);
+
+        for (int j = 0; j < blockSize; ++j)
+        {
+            std::array<float, blockSize> t{};
+            for (int lane = 0; lane < blockSize; ++lane)
+                t[(size_t)lane] = respond(0.0, 0.0, j, lane);
+
+            impulseResponse[(size_t)j] = load(t);
+        }
+    }
+
+    //processes in place, state is the usual transposed direct form II pair
+    void process(float* data, int numSamples, float& s1, float& s2) const
+    {
+        const auto& c = coefficients;
+        int i = 0;
+
+        for (; i + blockSize <= numSamples; i += blockSize)
+        {
+            auto* x = data + i;
+
+            auto y = stateResponse1 * s1 + stateResponse2 * s2;
+            for (int j = 0; j < blockSize; ++j)
+                y = y + impulseResponse[(size_t)j] * x[j];
+
+            const auto yLast = y.get(blockSize - 1);
+            const auto yPrev = y.get(blockSize - 2);
+            const auto xLast = x[blockSize - 1];
+            const auto xPrev = x[blockSize - 2];
+
+            s1 = c[1] * xLast - c[3] * yLast + c[2] * xPrev - c[4] * yPrev;
+            s2 = c[2] * xLast - c[4] * yLast;
+
+            for (int j = 0; j < blockSize; ++j)
+                x[j] = y.get((size_t)j);
+        }
+
+        //whatever doesn't fill a whole step goes through the plain recurrence
+        for (; i < numSamples; ++i)
+        {
+            const auto x = data[i];
+            const auto y = c[0] * x + s1;
+            s1 = c[1] * x - c[3] * y + s2;
+            s2 = c[2] * x - c[4] * y;
+            data[i] = y;
+        }
+    }
+
+private:
+    BiquadCoefficients coefficients{};
+    Vec stateResponse1, stateResponse2;
+    std::array<Vec, blockSize> impulseResponse;
+
+    static Vec load(const std::array<float, blockSize>& values)
+    {
+        auto v = Vec::expand(0.f);
+        for (int lane = 0; lane < blockSize; ++lane)
+            v.set((size_t)lane, values[(size_t)lane]);
+        return v;
+    }
+};
+
+//runs a chain of biquads over all channels at once
+//channels sit side by side in the lanes of a SIMDRegister, so one set of coefficients is shared
+//and each lane just keeps its own state. stereo costs the same as mono this way
+//stages that aren't active are left out of the processing path completely, and whenever the set of
+//running stages changes the old set keeps going on a copy of the state for a few ms while we crossfade over
+//new coefficients don't jump in either: they're ramped in on a fixed grid of short sub-blocks, see setStage
+template<int NumStages>
+struct SIMDBiquadCascade
+{
+    using Vec = juce::dsp::SIMDRegister<float>;
+    static constexpr int numLanes = (int)Vec::SIMDNumElements;
+
+    void prepare(const juce::dsp::ProcessSpec& spec)
+    {
+        numChannels = (int)spec.numChannels;
+        maxBlockSize = (int)spec.maximumBlockSize;
+        numGroups = (numChannels + numLanes - 1) / numLanes;
+
+        //one interleaved frame per sample, reused for every group of channels
+        interleaved.assign((size_t)maxBlockSize, Vec::expand(0.f));
+        fadeScratch.assign((size_t)maxBlockSize, Vec::expand(0.f));
+        state.assign((size_t)(numGroups * NumStages), { Vec::expand(0.f), Vec::expand(0.f) });
+        fadingOutState = state;
+
+        fadeLength = juce::jmax(1, (int)(spec.sampleRate * crossfadeSeconds));
+        fadeSamplesRemaining = 0;
+
+        numRampSteps = juce::jmax(1, juce::roundToInt(spec.sampleRate * rampSeconds / subBlockSize));
+        finishRamps();
+    }
+
+    //clears the filter state and snaps every stage straight to its target coefficients
+    void reset()
+    {
+        for (auto& s : state)
+            s = { Vec::expand(0.f), Vec::expand(0.f) };
+
+        fadeSamplesRemaining = 0;
+        finishRamps();
+
+        //a change that was waiting for the fade to finish just takes over, there's nothing left to fade from
+        if (hasPendingActive)
+        {
+            active = pendingActive;
+            current = makeActiveSet(active);
+            hasPendingActive = false;
+        }
+    }
+
+    //sets where a stage's coefficients should end up. running stages glide there in straight lines,
+    //one step every subBlockSize samples, so the update cost per second is fixed whatever the host block size.
+    //a straight line between two stable biquads stays stable: the set of stable (a1, a2) is a triangle,
+    //and a triangle is convex. stages that aren't running just jump, nobody can hear them
+    void setStage(int index, const BiquadCoefficients& coefficients)
+    {
+        jassert(juce::isPositiveAndBelow(index, NumStages));
+        const auto stage = (size_t)index;
+
+        targetCoefficients[stage] = coefficients;
+
+        if (!active[stage])
+        {
+            if (rampStepsRemaining[stage] > 0)
+                --numRamping;
+
+            rampStepsRemaining[stage] = 0;
+            applyStage(index, coefficients);
+            return;
+        }
+
+        if (rampStepsRemaining[stage] == 0)
+            ++numRamping;
+
+        rampStepsRemaining[stage] = numRampSteps;
+
+        for (size_t i = 0; i < coefficients.size(); ++i)
+            rampIncrement[stage][i] = (coefficients[i] - currentCoefficients[stage][i]) / (float)numRampSteps;
+    }
+
+    //takes the whole on/off pattern at once, so one update only ever starts one crossfade.
+    //a change that comes in while a fade is running waits for it to finish, cutting the fade short would jump
+    //from the blend straight to the outgoing set. only the newest waiting pattern is kept
+    void setActiveStages(const std::array<bool, NumStages>& newActive)
+    {
+        if (fadeSamplesRemaining > 0)
+        {
+            pendingActive = newActive;
+            hasPendingActive = newActive != active;
+            return;
+        }
+
+        if (newActive != active)
+            startFade(newActive);
+    }
+
+    void process(const juce::dsp::ProcessContextReplacing<float>& context)
+    {
+        auto& block = context.getOutputBlock();
+        const auto channelsToProcess = juce::jmin((int)block.getNumChannels(), numChannels);
+        const auto numSamples = (int)block.getNumSamples();
+
+        //nothing running and nothing fading out means the audio passes straight through
+        if (context.isBypassed || (current.size == 0 && fadeSamplesRemaining == 0))
+            return;
+
+        //hosts are allowed to hand us a bit more than they promised, chop it up instead of overrunning the scratch
+        for (int start = 0; start < numSamples;)
+        {
+            auto length = juce::jmin(maxBlockSize, numSamples - start);
+
+            //while anything is gliding, take one step every subBlockSize samples. the count carries over from one
+            //call to the next, so the grid (and with it the glide time and its cost) doesn't follow the host's blocks
+            const auto ramping = numRamping > 0;
+            if (ramping)
+            {
+                if (samplesUntilNextStep == 0)
+                {
+                    advanceRamps();
+                    samplesUntilNextStep = subBlockSize;
+                }
+
+                length = juce::jmin(length, samplesUntilNextStep);
+            }
+
+            const auto fading = fadeSamplesRemaining > 0;
+
+            for (int group = 0; group < numGroups; ++group)
+            {
+                const auto firstChannel = group * numLanes;
+                const auto groupChannels = juce::jmin(numLanes, channelsToProcess - firstChannel);
+
+                if (groupChannels <= 0)
+                    break;
+
+                //a lone channel would waste all but one lane, run it through the time-domain kernel instead
+                if (groupChannels == 1)
+                {
+                    auto* data = block.getChannelPointer((size_t)firstChannel) + start;
+
+                    refreshKernels(stageCoefficients, blockKernels, kernelsStale);
+
+                    if (fading)
+                    {
+                        refreshKernels(fadingOutCoefficients, fadingOutKernels, fadingOutKernelsStale);
+
+                        auto* old = reinterpret_cast<float*>(fadeScratch.data());
+                        std::copy(data, data + length, old);
+                        processSingleChannel(fadingOut, fadingOutKernels, fadingOutState, group, old, length);
+                        processSingleChannel(current, blockKernels, state, group, data, length);
+                        crossfade(data, old, length, 1);
+                    }
+                    else
+                    {
+                        processSingleChannel(current, blockKernels, state, group, data, length);
+                    }
+
+                    continue;
+                }
+
+                interleave(block, firstChannel, groupChannels, start, length);
+
+                if (fading)
+                {
+                    std::copy(interleaved.begin(), interleaved.begin() + length, fadeScratch.begin());
+                    fadingOut.kernel(fadingOutCoefficients, fadingOut.stages, &fadingOutState[(size_t)(group * NumStages)], fadeScratch.data(), length);
+                }
+
+                current.kernel(stageCoefficients, current.stages, &state[(size_t)(group * NumStages)], interleaved.data(), length);
+
+                if (fading)
+                    crossfade(reinterpret_cast<float*>(interleaved.data()), reinterpret_cast<const float*>(fadeScratch.data()), length, numLanes);
+
+                deinterleave(block, firstChannel, groupChannels, start, length);
+            }
+
+            if (ramping)
+                samplesUntilNextStep -= length;
+
+            if (fading)
+            {
+                fadeSamplesRemaining = juce::jmax(0, fadeSamplesRemaining - length);
+
+                if (fadeSamplesRemaining == 0 && hasPendingActive)
+                {
+                    hasPendingActive = false;
+                    startFade(pendingActive);
+                }
+            }
+
+            start += length;
+        }
+    }
+
+private:
+    static constexpr double crossfadeSeconds = 0.005;
+    static constexpr double rampSeconds = 0.02;
+    static constexpr int subBlockSize = 32;
+
+    using Coefficients = std::array<std::array<Vec, 5>, NumStages>;
+    using Kernel = void (*)(const Coefficients&, const std::array<int, NumStages>&, std::array<Vec, 2>*, Vec*, int);
+
+    //which stages run, in order, plus the fused kernel built for that many
+    struct ActiveSet
+    {
+        std::array<int, NumStages> stages{};
+        int size = 0;
+        Kernel kernel = &processFused<0>;
+    };
+
+    int numChannels = 0, maxBlockSize = 0, numGroups = 0;
+
+    Coefficients stageCoefficients{};
+    std::array<BlockBiquadKernel, NumStages> blockKernels;
+    std::array<bool, NumStages> active{}, pendingActive{};
+    bool hasPendingActive = false;
+    ActiveSet current, fadingOut;
+
+    //what the outgoing set was running with when its fade started. the ramps move stageCoefficients on
+    //towards the new design, the outgoing set has to keep sounding like the old one
+    Coefficients fadingOutCoefficients{};
+    std::array<BlockBiquadKernel, NumStages> fadingOutKernels;
+
+    //the time-domain kernels are only used for a lone channel, any other layout never looks at them.
+    //so a new set of coefficients just marks them, and they're rebuilt when a lone channel actually comes along
+    std::array<bool, NumStages> kernelsStale{}, fadingOutKernelsStale{};
+
+    //transposed direct form II needs two state values per stage, per group of lanes
+    std::vector<std::array<Vec, 2>> state, fadingOutState;
+    std::vector<Vec> interleaved, fadeScratch;
+
+    int fadeLength = 0, fadeSamplesRemaining = 0;
+
+    //what each stage is running with right now, where it is heading, and how far it moves per sub-block
+    std::array<BiquadCoefficients, NumStages> currentCoefficients{}, targetCoefficients{}, rampIncrement{};
+    std::array<int, NumStages> rampStepsRemaining{};
+    int numRampSteps = 1, numRamping = 0;
+    int samplesUntilNextStep = 0;
+
+    //coefficients are broadcast once here, so the sample loop never has to
+    void applyStage(int index, const BiquadCoefficients& coefficients)
+    {
+        const auto stage = (size_t)index;
+        currentCoefficients[stage] = coefficients;
+
+        for (size_t i = 0; i < coefficients.size(); ++i)
+            stageCoefficients[stage][i] = Vec::expand(coefficients[i]);
+
+        kernelsStale[stage] = true;
+    }
+
+    static void refreshKernels(const Coefficients& coefficients, std::array<BlockBiquadKernel, NumStages>& kernels,
+                               std::array<bool, NumStages>& stale)
+    {
+        for (size_t stage = 0; stage < (size_t)NumStages; ++stage)
+        {
+            if (!stale[stage])
+                continue;
+
+            BiquadCoefficients c;
+            for (size_t i = 0; i < c.size(); ++i)
+                c[i] = coefficients[stage][i].get(0);
+
+            kernels[stage].setCoefficients(c);
+            stale[stage] = false;
+        }
+    }
+
+    void advanceRamps()
+    {
+        for (int index = 0; index < NumStages; ++index)
+        {
+            const auto stage = (size_t)index;
+
+            if (rampStepsRemaining[stage] == 0)
+                continue;
+
+            //land exactly on the target instead of wherever the rounding left us
+            if (--rampStepsRemaining[stage] == 0)
+            {
+                --numRamping;
+                applyStage(index, targetCoefficients[stage]);
+                continue;
+            }
+
+            auto next = currentCoefficients[stage];
+            for (size_t i = 0; i < next.size(); ++i)
+                next[i] += rampIncrement[stage][i];
+
+            applyStage(index, next);
+        }
+    }
+
+    void finishRamps()
+    {
+        for (int index = 0; index < NumStages; ++index)
+        {
+            rampStepsRemaining[(size_t)index] = 0;
+            applyStage(index, targetCoefficients[(size_t)index]);
+        }
+
+        numRamping = 0;
+        samplesUntilNextStep = 0;
+    }
+
+    static ActiveSet makeActiveSet(const std::array<bool, NumStages>& isActive)
+    {
+        ActiveSet set;
+        for (int stage = 0; stage < NumStages; ++stage)
+            if (isActive[(size_t)stage])
+                set.stages[(size_t)set.size++] = stage;
+
+        //jump straight to the kernel built for this many stages
+        set.kernel = kernelFor(set.size, std::make_index_sequence<NumStages + 1>{});
+        return set;
+    }
+
+    void startFade(const std::array<bool, NumStages>& newActive)
+    {
+        //the outgoing set carries on with its own copy of the state and coefficients until the fade is done
+        //(copying into the same sized vector doesn't allocate)
+        fadingOut = current;
+        fadingOutState = state;
+        fadingOutCoefficients = stageCoefficients;
+        fadingOutKernels = blockKernels;
+        fadingOutKernelsStale = kernelsStale;
+        fadeSamplesRemaining = fadeLength;
+
+        //a stage coming back starts from silence, the crossfade hides its start-up
+        for (int stage = 0; stage < NumStages; ++stage)
+            if (newActive[(size_t)stage] && !active[(size_t)stage])
+                resetStage(stage);
+
+        active = newActive;
+        current = makeActiveSet(active);
+    }
+
+    void resetStage(int index)
+    {
+        for (int group = 0; group < numGroups; ++group)
+            state[(size_t)(group * NumStages + index)] = { Vec::expand(0.f), Vec::expand(0.f) };
+    }
+
+    //linear fade from the old set's output into the new one, continuing wherever the last block left off
+    void crossfade(float* data, const float* old, int length, int stride)
+    {
+        const auto fadeStart = fadeLength - fadeSamplesRemaining;
+
+        for (int i = 0; i < length; ++i)
+        {
+            const auto gain = juce::jmin(1.f, (float)(fadeStart + i) / (float)fadeLength);
+
+            for (int lane = 0; lane < stride; ++lane)
+            {
+                const auto index = i * stride + lane;
+                data[index] = old[index] + gain * (data[index] - old[index]);
+            }
+        }
+    }
+
+    void interleave(const juce::dsp::AudioBlock<float>& block, int firstChannel, int groupChannels, int start, int length)
+    {
+        auto* dest = reinterpret_cast<float*>(interleaved.data());
+
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            //unused lanes just carry silence through the filters
+            if (lane < groupChannels)
+            {
+                const auto* src = block.getChannelPointer((size_t)(firstChannel + lane)) + start;
+                for (int i = 0; i < length; ++i)
+                    dest[i * numLanes + lane] = src[i];
+            }
+            else
+            {
+                for (int i = 0; i < length; ++i)
+                    dest[i * numLanes + lane] = 0.f;
+            }
+        }
+    }
+
+    void deinterleave(juce::dsp::AudioBlock<float>& block, int firstChannel, int groupChannels, int start, int length)
+    {
+        const auto* src = reinterpret_cast<const float*>(interleaved.data());
+
+        for (int lane = 0; lane < groupChannels; ++lane)
+        {
+            auto* dest = block.getChannelPointer((size_t)(firstChannel + lane)) + start;
+            for (int i = 0; i < length; ++i)
+                dest[i] = src[i * numLanes + lane];
+        }
+    }
+
+    static void processSingleChannel(const ActiveSet& set, std::array<BlockBiquadKernel, NumStages>& kernels,
+                                     std::vector<std::array<Vec, 2>>& states, int group, float* data, int length)
+    {
+        for (int s = 0; s < set.size; ++s)
+        {
+            const auto stage = set.stages[(size_t)s];
+            auto& stageState = states[(size_t)(group * NumStages + stage)];
+
+            //the lone channel keeps its state in lane 0
+            auto s1 = stageState[0].get(0);
+            auto s2 = stageState[1].get(0);
+
+            kernels[(size_t)stage].process(data, length, s1, s2);
+
+            stageState[0].set(0, s1);
+            stageState[1].set(0, s2);
+        }
+    }
+
+    //one fused kernel per number of active stages. the stage loop has a compile-time length so it unrolls,
+    //every stage's state is pulled into locals for the whole block and each sample goes through the full cascade
+    //before the next one is loaded - no bypass checks, no per-stage passes over memory
+    //the kernel only depends on how many stages run (their order is fixed), so every
+    //lowCut slope x highCut slope x peak on/off combination with the same count shares one specialisation
+    template<int NumActive>
+    static void processFused(const Coefficients& coefficients, const std::array<int, NumStages>& stages,
+                             std::array<Vec, 2>* groupState, Vec* data, int length)
+    {
+        if constexpr (NumActive == 0)
+        {
+            juce::ignoreUnused(coefficients, stages, groupState, data, length);
+        }
+        else
+        {
+            std::array<std::array<Vec, 5>, NumActive> c;
+            std::array<Vec, NumActive> s1, s2;
+
+            for (size_t k = 0; k < (size_t)NumActive; ++k)
+            {
+                const auto stage = (size_t)stages[k];
+
+                c[k] = coefficients[stage];
+                s1[k] = groupState[stage][0];
+                s2[k] = groupState[stage][1];
+            }
+
+            for (int i = 0; i < length; ++i)
+            {
+                auto x = data[i];
+
+                for (size_t k = 0; k < (size_t)NumActive; ++k)
+                {
+                    const auto y = c[k][0] * x + s1[k];
+                    s1[k] = c[k][1] * x - c[k][3] * y + s2[k];
+                    s2[k] = c[k][2] * x - c[k][4] * y;
+                    x = y;
+                }
+
+                data[i] = x;
+            }
+
+            for (size_t k = 0; k < (size_t)NumActive; ++k)
+                groupState[(size_t)stages[k]] = { s1[k], s2[k] };
+        }
+    }
+
+    template<size_t... I>
+    static Kernel kernelFor(int numActive, std::index_sequence<I...>)
+    {
+        static constexpr Kernel kernels[] = { &processFused<(int)I>... };
+        return kernels[numActive];
+    }
+};
@@ -0,0 +1,125 @@
+/*
+  ==============================================================================
+
+    Streaming decimate-by-two for the analyzer.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+
+//windowed-sinc half-band lowpass, then every second sample is kept.
+//every other tap of a half-band filter is zero, so only the others and the centre are stored and summed.
+//more taps buy a narrower transition around a quarter of the input rate, see the two sizes below
+template<int NumTaps>
+struct HalfBandDecimator
+{
+    static constexpr int numTaps = NumTaps;
+    static constexpr int centreTap = numTaps / 2;
+
+    HalfBandDecimator()
+    {
+        const auto& taps = getTaps();
+        for (int i = 0; i < numSincTaps; ++i)
+            sincTaps[(size_t)i] = taps[(size_t)(2 * i)];
+
+        centreGain = taps[centreTap];
+
+        reset();
+    }
+
+    void reset()
+    {
+        history.fill(0.f);
+        writePosition = 0;
+        outputDue = false;
+    }
+
+    //how many samples the next process() call will write for numInputSamples in
+    int getNumOutputSamples(int numInputSamples) const
+    {
+        return (numInputSamples + (outputDue ? 1 : 0)) / 2;
+    }
+
+    //output has to have room for getNumOutputSamples(numInputSamples), returns how many were written
+    int process(const float* input, int numInputSamples, float* output)
+    {
+        int numOutputSamples = 0;
+
+        for (int i = 0; i < numInputSamples; ++i)
+        {
+            //every sample goes in twice so the newest numTaps are always contiguous
+            history[(size_t)writePosition] = input[i];
+            history[(size_t)(writePosition + numTaps)] = input[i];
+            writePosition = (writePosition + 1) % numTaps;
+
+            if (outputDue)
+            {
+                const auto* oldest = history.data() + writePosition;
+
+                auto sum = centreGain * oldest[centreTap];
+                for (int t = 0; t < numSincTaps; ++t)
+                    sum += sincTaps[(size_t)t] * oldest[2 * t];
+
+                output[numOutputSamples++] = sum;
+            }
+
+            outputDue = !outputDue;
+        }
+
+        return numOutputSamples;
+    }
+
+private:
+    //with numTaps = 4n + 3, taps 0, 2, 4... are the ones that aren't zero, the centre (odd) is the exception
+    static_assert(numTaps % 4 == 3, "the outermost taps have to be the non-zero ones");
+    static constexpr int numSincTaps = (numTaps + 1) / 2;
+
+    std::array<float, numSincTaps> sincTaps;
+    float centreGain = 0.5f;
+    std::array<float, numTaps * 2> history;
+    int writePosition = 0;
+    bool outputDue = false;
+
+    //sinc(n / 2) / 2 under a blackman window, normalised to unity gain at dc
+    static const std::array<float, numTaps>& getTaps()
+    {
+        static const auto taps = []
+        {
+            std::array<double, numTaps> h{};
+            double sum = 0;
+
+            for (int i = 0; i < numTaps; ++i)
+            {
+                const auto n = i - centreTap;
+                const auto sinc = n == 0 ? 0.5 : std::sin(juce::MathConstants<double>::halfPi * n) / (juce::MathConstants<double>::pi * n);
+                const auto phase = juce::MathConstants<double>::twoPi * i / (numTaps - 1);
+                const auto window = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+
+                h[(size_t)i] = sinc * window;
+                sum += h[(size_t)i];
+            }
+
+            std::array<float, numTaps> normalised{};
+            for (int i = 0; i < numTaps; ++i)
+                normalised[(size_t)i] = (float)(h[(size_t)i] / sum);
+
+            return normalised;
+        }();
+
+        return taps;
+    }
+};
+
+//flat to within 0.01dB up to an eighth of the input rate and down more than 70dB from three eighths on,
+//so the lower half of the output band is clean enough to draw under the analyzer's floor
+using AnalyzerLevelDecimator = HalfBandDecimator<31>;
+
+//sized for the 44.1k family, where the transition is only 0.227 to 0.273 of the input rate: within 0.002dB
+//up to 20kHz at 88.2k and down more than 72dB from 24.1kHz, the lowest frequency that folds back under 20kHz.
+//the 48k family has more room (under 0.001dB to 20kHz, more than 79dB from 28kHz at 96k)
+using SampleRateDecimator = HalfBandDecimator<119>;
@@ -0,0 +1,59 @@
+/*
+  ==============================================================================
+
+    Counts a thread's trips to the heap, debug builds only.
+
+  ==============================================================================
+*/
+
+#include "HeapCounter.h"
+
+#if JUCE_DEBUG
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    //plain thread_locals with constant initialisers, safe to touch from operator new at any point in a thread's life
+    thread_local bool counting = false;
+    thread_local int numHeapCalls = 0;
+
+    void* allocate(std::size_t size)
+    {
+        if (counting)
+            ++numHeapCalls;
+
+        if (auto* p = std::malloc(size == 0 ? 1 : size))
+            return p;
+
+        throw std::bad_alloc();
+    }
+}
+
+ScopedHeapCount::ScopedHeapCount() :
+    wasCounting(counting),
+    countAtStart(numHeapCalls)
+{
+    counting = true;
+}
+
+ScopedHeapCount::~ScopedHeapCount()
+{
+    counting = wasCounting;
+}
+
+int ScopedHeapCount::get() const
+{
+    return numHeapCalls - countAtStart;
+}
+
+//the nothrow forms call these by default, the aligned ones have their own and aren't counted
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+#endif
@@ -0,0 +1,31 @@
+/*
+  ==============================================================================
+
+    Counts a thread's trips to the heap, debug builds only.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//while one of these is alive, every operator new on the thread that made it is counted. debug builds replace
+//the global operator new for that (HeapCounter.cpp), release builds always see 0.
+//anything that goes to malloc directly, like the HeapBlock under juce::AudioBuffer, isn't seen
+struct ScopedHeapCount
+{
+   #if JUCE_DEBUG
+    ScopedHeapCount();
+    ~ScopedHeapCount();
+
+    //operator new calls made on this thread since construction
+    int get() const;
+
+private:
+    bool wasCounting;
+    int countAtStart;
+   #else
+    int get() const { return 0; }
+   #endif
+};
@@ -0,0 +1,134 @@
+/*
+  ==============================================================================
+
+    Every parameter of the plugin, described once.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+
+//one entry per parameter, the table below is the only place the IDs are spelled out
+enum ParameterIndex
+{
+    Param_LowCutFreq,
+    Param_HighCutFreq,
+    Param_PeakFreq,
+    Param_PeakGain,
+    Param_PeakQuality,
+    Param_LowCutSlope,
+    Param_HighCutSlope,
+    Param_FilterEngine,
+
+    Param_Count
+};
+
+enum class ParameterKind
+{
+    Float,
+    Choice
+};
+
+constexpr const char* slopeChoices[] = { "12 dB/Oct", "24 dB/Oct", "36 dB/Oct", "48 dB/Oct" };
+constexpr const char* engineChoices[] = { "Biquad", "SVF" };
+
+struct ParameterInfo
+{
+    const char* id;         //doubles as the display name
+    ParameterKind kind;
+
+    //float parameters
+    float min, max, interval, skew;
+    //for choices this is the default index
+    float defaultValue;
+
+    //choice parameters
+    const char* const* choices;
+    int numChoices;
+
+    //what the editor's sliders print after the value
+    const char* suffix;
+};
+
+constexpr ParameterInfo makeFloatParameter(const char* id, float min, float max, float interval, float skew, float defaultValue, const char* suffix)
+{
+    return { id, ParameterKind::Float, min, max, interval, skew, defaultValue, nullptr, 0, suffix };
+}
+
+template<size_t N>
+constexpr ParameterInfo makeChoiceParameter(const char* id, const char* const (&choices)[N], int defaultIndex, const char* suffix)
+{
+    return { id, ParameterKind::Choice, 0.f, (float)(N - 1), 1.f, 1.f, (float)defaultIndex, choices, (int)N, suffix };
+}
+
+//low and high cut default to the edges of the audible band, peak to 750Hz and flat
+constexpr std::array<ParameterInfo, Param_Count> parameterInfos{ {
+    makeFloatParameter("LowCut Freq", 20.f, 20000.f, 1.f, 0.25f, 20.f, "Hz"),
+    makeFloatParameter("HighCut Freq", 20.f, 20000.f, 1.f, 0.25f, 20000.f, "Hz"),
+    makeFloatParameter("Peak Freq", 20.f, 20000.f, 1.f, 0.25f, 750.f, "Hz"),
+    makeFloatParameter("Peak Gain", -24.f, 24.f, 0.5f, 1.f, 0.f, "dB"),
+    makeFloatParameter("Peak Quality", 0.1f, 10.f, 0.5f, 1.f, 1.f, ""),
+    makeChoiceParameter("LowCut Slope", slopeChoices, 0, "dB/Oct"),
+    makeChoiceParameter("HighCut Slope", slopeChoices, 0, "dB/Oct"),
+    makeChoiceParameter("Filter Engine", engineChoices, 0, ""),
+} };
+
+constexpr const char* getParameterID(ParameterIndex index) { return parameterInfos[(size_t)index].id; }
+
+//builds the apvts layout straight from the table
+inline juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayoutFromTable()
+{
+    juce::AudioProcessorValueTreeState::ParameterLayout layout;
+
+    for (const auto& info : parameterInfos)
+    {
+        if (info.kind == ParameterKind::Float)
+        {
+            layout.add(std::make_unique<juce::AudioParameterFloat>(info.id, info.id,
+                juce::NormalisableRange<float>(info.min, info.max, info.interval, info.skew), info.defaultValue));
+        }
+        else
+        {
+            juce::StringArray choices;
+            for (int i = 0; i < info.numChoices; ++i)
+                choices.add(info.choices[i]);
+
+            layout.add(std::make_unique<juce::AudioParameterChoice>(info.id, info.id, choices, (int)info.defaultValue));
+        }
+    }
+
+    return layout;
+}
+
+//looks every parameter up once, after that reading one is a single atomic load
+struct CachedParameters
+{
+    CachedParameters(juce::AudioProcessorValueTreeState& apvts)
+    {
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            values[i] = apvts.getRawParameterValue(parameterInfos[i].id);
+            jassert(values[i] != nullptr);
+        }
+    }
+
+    //floats come back as float, choices as their index
+    template<ParameterIndex Index>
+    auto get() const
+    {
+        const auto value = values[(size_t)Index]->load(std::memory_order_relaxed);
+
+        if constexpr (parameterInfos[(size_t)Index].kind == ParameterKind::Choice)
+            return juce::roundToInt(value);
+        else
+            return value;
+    }
+
+private:
+    std::array<std::atomic<float>*, Param_Count> values{};
+};
@@ -182,18 +182,30 @@ juce::String RotarySliderWithLabels::getDisplayString() const {
 //==============================================================================
 
 ResponseCurveComponent::ResponseCurveComponent(CompASAudioProcessor& p) : audioProcessor(p),
-leftPathProducer(audioProcessor.leftChannelFifo),
-rightPathProducer(audioProcessor.rightChannelFifo)
+pathProducer(audioProcessor.leftChannelFifo, audioProcessor.rightChannelFifo)
 {
     const auto& params = audioProcessor.getParameters();
     for (auto param : params) {
         param->addListener(this);
     }
     updateChain();
-    startTimerHz(60);
+
+    //the floor in the editor's dark purple, up through the left trace's purple and the right trace's gold to white at 0dB
+    juce::ColourGradient waterfallGradient(juce::Colour(47u, 9u, 75u), 0.f, 0.f, juce::Colours::white, 1.f, 0.f, false);
+    waterfallGradient.addColour(0.4, juce::Colour(97u, 18u, 167u));
+    waterfallGradient.addColour(0.75, juce::Colour(215u, 201u, 134u));
+
+    for (size_t i = 0; i < waterfallColours.size(); ++i)
+        waterfallColours[i] = waterfallGradient.getColourAtPosition(double(i) / double(waterfallColours.size() - 1));
+
+    audioProcessor.attachAnalyzer();
+    analyzerThread.startThread();
+    startTimerHz(frameRate);
 }
 
 ResponseCurveComponent::~ResponseCurveComponent(){
+    audioProcessor.detachAnalyzer();
+
     const auto& params = audioProcessor.getParameters();
     for (auto param : params) {
         param->removeListener(this);
@@ -207,56 +219,14 @@ void ResponseCurveComponent::updateResponseCurve()
 {
     using namespace juce;
     auto responseArea = getAnalysisArea();
-    auto w = responseArea.getWidth();
-
-    auto& lowcut = MonoChain.get<ChainPositions::lowCut>();
-    auto& peak = MonoChain.get<ChainPositions::peak>();
-    auto& highcut = MonoChain.get<ChainPositions::highCut>();
-
-    auto sampleRate = audioProcessor.getSampleRate();
-
-    //mags=magnitude, we get magnitude from frequency, we'll store 
-    //in vector
-
-    //store one magnitude per pixel as per our width
-
-    std::vector<double> mags;
-
-    mags.resize(w);
-
-    for (int i = 0; i < w; ++i) {
-        double mag = 1.f; //these are expressed in gain units
-
-        //we use mapToLog10 to get map from pixel->frequency for human hearing range
-        auto freq = mapToLog10(double(i) / double(w), 20.0, 20000.0);
-
-        //we update magnitude 
-        //if band is bypassed, then ignore
-        if (!MonoChain.isBypassed<ChainPositions::peak>())
-            mag *= peak.coefficients->getMagnitudeForFrequency(freq, sampleRate);
-
-        //since we have 4 low-cut possible values, we need for all four
-        if (!lowcut.isBypassed<0>())
-            mag *= lowcut.get<0>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if (!lowcut.isBypassed<1>())
-            mag *= lowcut.get<1>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if (!lowcut.isBypassed<2>())
-            mag *= lowcut.get<2>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if (!lowcut.isBypassed<3>())
-            mag *= lowcut.get<3>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
 
-        // same for highcut
+    //one magnitude per pixel, already in dB, kept up to date stage by stage in updateChain()
+    const auto& mags = responseCache.getDecibels();
 
-        if (!highcut.isBypassed<0>())
-            mag *= highcut.get<0>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if (!highcut.isBypassed<1>())
-            mag *= highcut.get<1>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if (!highcut.isBypassed<2>())
-            mag *= highcut.get<2>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if (!highcut.isBypassed<3>())
-            mag *= highcut.get<3>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-
-        mags[i] = Decibels::gainToDecibels(mag);
+    if (mags.empty())
+    {
+        responseCurve.clear();
+        return;
     }
 
     //convert mag->path
@@ -284,78 +254,472 @@ void ResponseCurveComponent::updateResponseCurve()
 
 
 void ResponseCurveComponent::parameterValueChanged(int parameterIndex, float newValue) {
-    parametersChanged.set(true);
+    //processBlock asks for a design too, this covers hosts that stop calling it while the transport is stopped
+    //or have released the plugin, the designer keeps running either way
+    audioProcessor.requestCoefficientUpdate();
 }
 
 void PathProducer::process(juce::Rectangle<float> fftBounds, double sampleRate)
 {
-    juce::AudioBuffer<float> tempIncomingBuffer;
-    while (leftChannelFifo->getNumCompleteBuffersAvailable() > 0)
+    const auto steady = isSteady(fftBounds, sampleRate);
+    ScopedHeapCount heapCalls;
+
+    processFrame(fftBounds, sampleRate);
+
+    //nothing the analyzer is sized from has changed and everything going round has been sized for it,
+    //so this pass must have made do with what was already there
+    jassert(!steady || heapCalls.get() == 0);
+    juce::ignoreUnused(steady, heapCalls);
+}
+
+bool PathProducer::isSteady(juce::Rectangle<float> fftBounds, double sampleRate)
+{
+    const auto order = requestedOrder.load();
+    const auto currentView = view.load();
+    const auto width = (int)fftBounds.getWidth();
+    const auto drawn = pathGenerators[0].getNumDrawn();
+
+    if (order != sizedOrder || currentView != sizedView || width != sizedWidth || sampleRate != sizedSampleRate)
+    {
+        sizedOrder = order;
+        sizedView = currentView;
+        sizedWidth = width;
+        sizedSampleRate = sampleRate;
+        drawnWhenSized = drawn;
+        return false;
+    }
+
+    return drawn - drawnWhenSized >= pathGenerators[0].getNumWarmUpDrawings();
+}
+
+void PathProducer::processFrame(juce::Rectangle<float> fftBounds, double sampleRate)
+{
+    const auto wantedOrder = (FFTOrder)requestedOrder.load();
+    if (wantedOrder != levels[0].fftDataGenerator.getOrder())
+        changeOrder(wantedOrder);
+
+    if (sampleRate != preparedSampleRate)
+        prepareSampleRateStages(sampleRate);
+
+    const auto fftSize = levels[0].fftDataGenerator.getFFTSize();
+    const auto hopSize = fftSize / overlap.load();
+
+    //the taps deliver audio at the session rate, every hop of the full rate level takes decimation times as much
+    const auto decimation = 1 << numSampleRateStages;
+    const auto rawHopSize = hopSize * decimation;
+    const auto rawWindowSize = fftSize * decimation;
+
+    //what the taps had to throw away since last time because we didn't keep up, the waterfall still owes it rows
+    const auto droppedSamples = channelFifos[0]->getNumDroppedSamples();
+    missedSamples += droppedSamples >= lastDroppedSamples ? droppedSamples - lastDroppedSamples : droppedSamples;
+    lastDroppedSamples = droppedSamples;
+
+    //both taps are fed by the same processBlock, so they only ever differ by a block in flight
+    const auto available = juce::jmin(channelFifos[0]->getNumSamplesAvailable(),
+        channelFifos[1]->getNumSamplesAvailable());
+
+    const auto currentView = view.load();
+    if (currentView == AnalyzerView::View_Waterfall)
+    {
+        processWaterfall(fftBounds, sampleRate, hopSize, available);
+        return;
+    }
+
+    //the traces only ever show the newest frame, nothing is owed for what they missed
+    missedSamples = 0;
+
+    //the window only moves in whole hops, however the host happens to slice its buffers
+    if (available < rawHopSize)
+        return;
+
+    auto rawNewSamples = available / rawHopSize * rawHopSize;
+
+    if (rawNewSamples > rawWindowSize)
+    {
+        //we've fallen more than a whole window behind, skip straight to the newest window instead of
+        //computing every frame in between that would never be seen anyway
+        for (auto* fifo : channelFifos)
+            fifo->discardSamples(rawNewSamples - rawWindowSize);
+
+        rawNewSamples = rawWindowSize;
+    }
+
+    const auto newSamples = readHops(rawNewSamples);
+
+    //the paths would come out the same as last time, so there's nothing to do until the sound comes back
+    if (isSettledQuiet(newSamples, hopSize) && fftBounds == pathBounds && currentView == pathView)
+        return;
+
+    //one FFT per frame at most, so the cost follows the display rate rather than the host buffer size
+    analyseLevels(newSamples, hopSize);
+
+    pathBounds = fftBounds;
+    pathView = currentView;
+
+    const auto firstSpectrum = currentView == AnalyzerView::View_MidSide ? Spectrum_Mid : Spectrum_Left;
+
+    for (int trace = 0; trace < numTraces; ++trace)
+    {
+        const auto spectra = getSpectra(firstSpectrum + trace, sampleRate);
+        pathGenerators[(size_t)trace].generatePath(spectra.data(), numLevels, fftBounds, fftSize, negativeInfinity);
+    }
+}
+
+void PathProducer::processWaterfall(juce::Rectangle<float> fftBounds, double sampleRate, int hopSize, int available)
+{
+    //every hop of audio gets a row of its own, so the rows stand for the same stretch of time whatever the display
+    //rate is. when the gui hasn't made room for more, the rest of the audio waits in the taps for the next pass
+    auto& generator = pathGenerators[0];
+    const auto fftSize = levels[0].fftDataGenerator.getFFTSize();
+    const auto rawHopSize = hopSize << numSampleRateStages;
+
+    //hops the taps lost come out as copies of the row before them, to keep the rows after them in their place
+    while (missedSamples >= rawHopSize && generator.canTakeRow())
+    {
+        generator.repeatRow(fftBounds);
+        missedSamples -= rawHopSize;
+    }
+
+    for (; available >= rawHopSize && generator.canTakeRow(); available -= rawHopSize)
     {
-        if (leftChannelFifo->getAudioBuffer(tempIncomingBuffer))
+        const auto newSamples = readHops(rawHopSize);
+
+        //silence still takes up its rows, it just doesn't need an FFT to tell they're the same as the last one
+        if (isSettledQuiet(newSamples, hopSize) && fftBounds == pathBounds && pathView == AnalyzerView::View_Waterfall)
         {
-            auto size = tempIncomingBuffer.getNumSamples();
+            generator.repeatRow(fftBounds);
+            continue;
+        }
+
+        analyseLevels(newSamples, hopSize);
+
+        const auto spectra = getSpectra(Spectrum_Mid, sampleRate);
+        generator.generateRow(spectra.data(), numLevels, fftBounds, fftSize, negativeInfinity);
+
+        //the traces have to be drawn again when the view changes back
+        pathBounds = fftBounds;
+        pathView = AnalyzerView::View_Waterfall;
+    }
+}
+
+bool PathProducer::isSettledQuiet(int newSamples, int hopSize)
+{
+    const auto fftSize = levels[0].fftDataGenerator.getFFTSize();
+
+    auto quiet = true;
+    for (int channel = 0; channel < numTraces && quiet; ++channel)
+    {
+        const auto range = juce::FloatVectorOperations::findMinAndMax(levels[0].windowBuffer.getReadPointer(channel, fftSize - newSamples),
+            newSamples);
+        quiet = range.getStart() > -quietLevel && range.getEnd() < quietLevel;
+    }
+
+    quietSamples = quiet ? juce::jmin(quietSamples + newSamples, std::numeric_limits<int>::max() / 2) : 0;
 
-            juce::FloatVectorOperations::copy(monoBuffer.getWritePointer(0, 0),
-                monoBuffer.getReadPointer(0, size),
-                monoBuffer.getNumSamples() - size);
+    //once every level's window and its last hop lie inside the quiet stretch, all the spectra sit at the floor
+    return quietSamples > (fftSize + hopSize) << (numLevels - 1);
+}
+
+int PathProducer::readHops(int rawNewSamples)
+{
+    const auto decimation = 1 << numSampleRateStages;
+    const auto newSamples = rawNewSamples / decimation;
+    auto& fullRate = levels[0];
+    const auto fftSize = fullRate.fftDataGenerator.getFFTSize();
+
+    for (int channel = 0; channel < numTraces; ++channel)
+    {
+        auto* fifo = channelFifos[(size_t)channel];
+
+        //slide the window along, the new hops go into its end
+        auto* window = fullRate.windowBuffer.getWritePointer(channel);
+        juce::FloatVectorOperations::copy(window, window + newSamples, fftSize - newSamples);
+        auto* newest = window + fftSize - newSamples;
+
+        if (numSampleRateStages == 0)
+        {
+            fifo->pullSamples(newest, newSamples);
+            continue;
+        }
 
-            juce::FloatVectorOperations::copy(monoBuffer.getWritePointer(0, monoBuffer.getNumSamples() - size),
-                tempIncomingBuffer.getReadPointer(0, 0),
-                size);
+        //every stage but the last halves the audio in place, the last one writes straight into the window
+        auto* incoming = incomingBuffer.getWritePointer(channel);
+        fifo->pullSamples(incoming, rawNewSamples);
 
-            leftChannelFFTDataGenerator.produceFFTDataForRendering(monoBuffer, -48.f);
+        auto count = rawNewSamples;
+        for (int stage = 0; stage < numSampleRateStages; ++stage)
+        {
+            auto* destination = stage == numSampleRateStages - 1 ? newest : incoming;
+            count = sampleRateDecimators[(size_t)stage][(size_t)channel].process(incoming, count, destination);
         }
+
+        jassert(count == newSamples);
     }
 
-    const auto fftSize = leftChannelFFTDataGenerator.getFFTSize();
-    const auto binWidth = sampleRate / double(fftSize);
+    return newSamples;
+}
+
+void PathProducer::analyseLevels(int newSamples, int hopSize)
+{
+    const auto fftSize = levels[0].fftDataGenerator.getFFTSize();
+
+    analyseLevel(levels[0]);
+
+    //each level below gets the new samples of the one above at half the rate, so it fills its hops
+    //half as quickly and only runs its FFT once it has
+    auto numNewSamples = juce::jmin(newSamples, fftSize);
 
-    while (leftChannelFFTDataGenerator.getNumAvailableFFTDataBlocks() > 0)
+    for (int n = 1; n < numLevels; ++n)
     {
-        std::vector<float> fftData;
-        if (leftChannelFFTDataGenerator.getFFTData(fftData))
+        auto& above = levels[(size_t)n - 1];
+        auto& level = levels[(size_t)n];
+        const auto numDecimated = level.decimators[0].getNumOutputSamples(numNewSamples);
+
+        for (int channel = 0; channel < numTraces; ++channel)
+        {
+            auto* window = level.windowBuffer.getWritePointer(channel);
+
+            juce::FloatVectorOperations::copy(window, window + numDecimated, fftSize - numDecimated);
+
+            level.decimators[(size_t)channel].process(above.windowBuffer.getReadPointer(channel, fftSize - numNewSamples),
+                numNewSamples,
+                window + fftSize - numDecimated);
+        }
+
+        level.pendingSamples += numDecimated;
+
+        if (level.pendingSamples >= hopSize)
         {
-            pathProducer.generatePath(fftData, fftBounds, fftSize, binWidth, -48.f);
+            analyseLevel(level);
+            level.pendingSamples = 0;
         }
+
+        numNewSamples = numDecimated;
     }
+}
 
-    while (pathProducer.getNumPathsAvailable() > 0)
+std::array<SpectrumView, PathProducer::numLevels> PathProducer::getSpectra(int spectrum, double sampleRate) const
+{
+    const auto fftSize = levels[0].fftDataGenerator.getFFTSize();
+    const auto numBins = fftSize / 2;
+
+    std::array<SpectrumView, numLevels> spectra;
+    for (int n = 0; n < numLevels; ++n)
     {
-        pathProducer.getPath(leftChannelFFTPath);
+        spectra[(size_t)n] = { levels[(size_t)n].spectra + spectrum * numBins,
+            (float)(sampleRate / double(fftSize << (n + numSampleRateStages))) };
     }
+
+    return spectra;
+}
+
+void PathProducer::prepareSampleRateStages(double sampleRate)
+{
+    preparedSampleRate = sampleRate;
+    quietSamples = 0;
+
+    //halve while the output rate stays at 40k or more, so 20kHz stays in the decimator's flat band.
+    //88.2/96k take one stage, 176.4/192k two
+    numSampleRateStages = 0;
+    while (numSampleRateStages < maxSampleRateStages && sampleRate / double(2 << numSampleRateStages) >= 40000.0)
+        ++numSampleRateStages;
+
+    for (auto& stage : sampleRateDecimators)
+        for (auto& decimator : stage)
+            decimator.reset();
+
+    //a rate that needs fewer stages keeps the bigger buffer it already has
+    const auto incomingSize = levels[0].fftDataGenerator.getFFTSize() << numSampleRateStages;
+    incomingBuffer.setSize(numTraces, incomingSize, false, false, true);
+}
+
+void PathProducer::analyseLevel(AnalysisLevel& level)
+{
+    //the generator and the paths run on the same thread, so the frame can go straight into the arena
+    level.fftDataGenerator.produceFFTDataForRendering(level.windowBuffer, negativeInfinity, level.spectra);
+}
+
+void PathProducer::changeOrder(FFTOrder newOrder)
+{
+    //a smaller order fits in the arena we already have
+    const auto spectrumSize = ((size_t)1 << newOrder) / 2 * Spectrum_Count;
+    spectrumArena.assign(spectrumSize * numLevels, negativeInfinity);
+
+    for (int n = 0; n < numLevels; ++n)
+    {
+        auto& level = levels[(size_t)n];
+
+        level.fftDataGenerator.changeOrder(newOrder);
+
+        //keep the newest audio we have, a bigger window fills up from silence
+        const auto newSize = level.fftDataGenerator.getFFTSize();
+        const auto oldSize = level.windowBuffer.getNumSamples();
+        const auto samplesToKeep = juce::jmin(newSize, oldSize);
+
+        juce::AudioBuffer<float> newBuffer(numTraces, newSize);
+        newBuffer.clear();
+
+        for (int channel = 0; channel < numTraces && samplesToKeep > 0; ++channel)
+        {
+            juce::FloatVectorOperations::copy(newBuffer.getWritePointer(channel, newSize - samplesToKeep),
+                level.windowBuffer.getReadPointer(channel, oldSize - samplesToKeep),
+                samplesToKeep);
+        }
+
+        level.windowBuffer = std::move(newBuffer);
+
+        //nothing to show at this size until the level has run once
+        level.spectra = spectrumArena.data() + spectrumSize * (size_t)n;
+        level.pendingSamples = 0;
+    }
+
+    //the raw buffer is sized from the FFT, have it rebuilt on the next pass
+    preparedSampleRate = 0.0;
+    quietSamples = 0;
+}
+
+bool PathProducer::updatePaths()
+{
+    auto gotPath = false;
+
+    for (int trace = 0; trace < numTraces; ++trace)
+    {
+        auto& generator = pathGenerators[(size_t)trace];
+
+        while (generator.getNumPathsAvailable() > 0)
+        {
+            gotPath = generator.getPath(tracePaths[(size_t)trace]) || gotPath;
+        }
+    }
+
+    return gotPath;
+}
+
+void ResponseCurveComponent::setFFTOrder(FFTOrder newOrder)
+{
+    pathProducer.setOrder(newOrder);
+}
+
+void ResponseCurveComponent::setFFTOverlap(FFTOverlap newOverlap)
+{
+    pathProducer.setOverlap(newOverlap);
+}
+
+void ResponseCurveComponent::setAnalyzerView(AnalyzerView newView)
+{
+    pathProducer.setView(newView);
+    showWaterfall = newView == AnalyzerView::View_Waterfall;
+    repaint(getRenderArea());
+}
+
+void ResponseCurveComponent::addWaterfallRow()
+{
+    //rows made for a width we've since left behind are thrown away
+    if (waterfallImage.isNull() || (int)waterfallRow.size() != waterfallImage.getWidth())
+        return;
+
+    waterfallHistory.push(waterfallRow);
+
+    //everything moves down a line, the new row goes in at the top
+    waterfallImage.moveImageSection(0, 1, 0, 0, waterfallImage.getWidth(), waterfallImage.getHeight() - 1);
+    drawWaterfallRow(0, waterfallRow.data());
+}
+
+void ResponseCurveComponent::drawWaterfallRow(int y, const juce::uint8* row)
+{
+    juce::Image::BitmapData pixels(waterfallImage, 0, y, waterfallImage.getWidth(), 1, juce::Image::BitmapData::writeOnly);
+
+    for (int x = 0; x < pixels.width; ++x)
+        pixels.setPixelColour(x, 0, waterfallColours[row[x]]);
+}
+
+void ResponseCurveComponent::prepareWaterfall()
+{
+    const auto area = getAnalysisArea();
+
+    if (area.isEmpty())
+        return;
+
+    //the history only survives a change of height, the columns stand for other frequencies at another width
+    if (area.getWidth() != waterfallHistory.getWidth())
+        waterfallHistory.prepare(area.getWidth(), area.getHeight());
+
+    waterfallImage = juce::Image(juce::Image::PixelFormat::RGB, area.getWidth(), area.getHeight(), true);
+    waterfallImage.clear(waterfallImage.getBounds(), waterfallColours[0]);
+
+    const auto numRows = juce::jmin(waterfallHistory.getNumStoredRows(), area.getHeight());
+    for (int age = 0; age < numRows; ++age)
+        drawWaterfallRow(age, waterfallHistory.getRow(age));
 }
 
 /// all our blocks i.e. SCFS to FFT buffer to GUI path producer gets coordination here
 void ResponseCurveComponent::timerCallback() {
 
-    
-        auto fftBounds = getAnalysisArea().toFloat();
-        auto sampleRate = audioProcessor.getSampleRate();
+    //the analyzer thread did the heavy lifting since last frame, here we only swap its paths in
+    auto needsRepaint = pathProducer.updatePaths();
+
+    while (pathProducer.getWaterfallRow(waterfallRow))
+    {
+        addWaterfallRow();
+        needsRepaint = true;
+    }
 
-        leftPathProducer.process(fftBounds, sampleRate);
-        rightPathProducer.process(fftBounds, sampleRate);
+    analyzerThread.requestFrame(getAnalysisArea().toFloat(), audioProcessor.getSampleRate());
 
-    if (parametersChanged.compareAndSetBool(false, true))
+    if (audioProcessor.getCoefficientSnapshot().version != drawnVersion)
     {
         updateChain();
         updateResponseCurve();
+        renderCurveLayer();
+        needsRepaint = true;
     }
 
-    repaint();
+    //everything that moves is clipped to the frame, the labels around it never need drawing again
+    if (needsRepaint)
+        repaint(getRenderArea());
+
+    const auto newFrameRate = frameRateGovernor.update(audioProcessor.getProcessLoad(), juce::Time::getMillisecondCounterHiRes());
+    if (newFrameRate != frameRate)
+    {
+        frameRate = newFrameRate;
+        startTimerHz(frameRate);
+    }
 }
 
 void ResponseCurveComponent::updateChain() {
-    //update the monochain
-    auto chainSettings = getChainSettings(audioProcessor.apvts);
-    auto peakCoefficients = makePeakFilter(chainSettings, audioProcessor.getSampleRate());
-    updateCoefficients(MonoChain.get<ChainPositions::peak>().coefficients, peakCoefficients);
+    //the same set the audio thread gets, designed once by the processor
+    const auto& snapshot = audioProcessor.getCoefficientSnapshot();
+    const auto& chainCoefficients = snapshot.value;
+    const auto& chainSettings = chainCoefficients.settings;
+    drawnVersion = snapshot.version;
+
+    //a new grid invalidates every stage, otherwise only the ones whose design moved are evaluated again
+    const auto redrawAll = responseCache.prepare(getAnalysisArea().getWidth(), chainCoefficients.sampleRate);
+    const auto& drawn = drawnCoefficients;
+
+    //nothing designed yet (the processor hasn't been prepared), the curve stays flat
+    if (snapshot.version == 0)
+        return;
+
+    //show the same stages the processor actually runs, the first (slope + 1) sections of each cut
+    if (redrawAll || chainCoefficients.lowCut != drawn.lowCut || chainCoefficients.lowCutActive != drawn.lowCutActive
+        || chainSettings.lowCutSlope != drawn.settings.lowCutSlope)
+    {
+        responseCache.setStage(ResponseCurveCache::Stage_LowCut, chainCoefficients.lowCut.data(),
+            chainSettings.lowCutSlope + 1, chainCoefficients.lowCutActive);
+    }
 
-    auto lowcutCoeff = makeLowCutFilter(chainSettings, audioProcessor.getSampleRate());
-    auto highcutCoeff = makeHighCutFilter(chainSettings, audioProcessor.getSampleRate());
-    updateCutFilter(MonoChain.get<ChainPositions::lowCut>(), lowcutCoeff, chainSettings.lowCutSlope);
-    updateCutFilter(MonoChain.get<ChainPositions::highCut>(), highcutCoeff, chainSettings.highCutSlope);
+    if (redrawAll || chainCoefficients.peak != drawn.peak || chainCoefficients.peakActive != drawn.peakActive)
+        responseCache.setStage(ResponseCurveCache::Stage_Peak, &chainCoefficients.peak, 1, chainCoefficients.peakActive);
 
+    if (redrawAll || chainCoefficients.highCut != drawn.highCut || chainCoefficients.highCutActive != drawn.highCutActive
+        || chainSettings.highCutSlope != drawn.settings.highCutSlope)
+    {
+        responseCache.setStage(ResponseCurveCache::Stage_HighCut, chainCoefficients.highCut.data(),
+            chainSettings.highCutSlope + 1, chainCoefficients.highCutActive);
+    }
+
+    drawnCoefficients = chainCoefficients;
 }
 
 void ResponseCurveComponent::paint(juce::Graphics& g)
@@ -372,28 +736,56 @@ void ResponseCurveComponent::paint(juce::Graphics& g)
     // FFT analysis paint
     //
 
-    auto leftChannelFFTPath = leftPathProducer.getPath();
-    leftChannelFFTPath.applyTransform(AffineTransform().translation(responseArea.getX(), responseArea.getY()));
+    {
+        //kept inside the frame, which is all timerCallback repaints
+        Graphics::ScopedSaveState state(g);
+        g.reduceClipRegion(getRenderArea());
 
-    g.setColour(Colour(97u, 18u, 167u)); //purple-
-    g.strokePath(leftChannelFFTPath, PathStrokeType(1.f));
+        //the paths are stroked where they are, moved into place by the transform rather than by a copy
+        const auto toResponseArea = AffineTransform::translation((float)responseArea.getX(), (float)responseArea.getY());
 
-    auto rightChannelFFTPath = rightPathProducer.getPath();
-    rightChannelFFTPath.applyTransform(AffineTransform().translation(responseArea.getX(), responseArea.getY()));
+        if (showWaterfall)
+        {
+            //one blit however much history there is
+            g.drawImageAt(waterfallImage, responseArea.getX(), responseArea.getY());
+        }
+        else
+        {
+            g.setColour(Colour(97u, 18u, 167u)); //purple-
+            g.strokePath(pathProducer.getPath(0), PathStrokeType(1.f), toResponseArea);
 
-    g.setColour(Colour(215u, 201u, 134u));
-    g.strokePath(rightChannelFFTPath, PathStrokeType(1.f));
+            g.setColour(Colour(215u, 201u, 134u));
+            g.strokePath(pathProducer.getPath(1), PathStrokeType(1.f), toResponseArea);
+        }
+    }
 
     // End 
-    
+
+    //frame and response curve, drawn into their own layer when the curve changed
+    g.drawImageAt(curveLayer, 0, 0);
+}
+
+void ResponseCurveComponent::renderCurveLayer()
+{
+    using namespace juce;
+
+    if (getWidth() <= 0 || getHeight() <= 0)
+        return;
+
+    //reused from one change to the next, only a new size needs a new image
+    if (curveLayer.getWidth() != getWidth() || curveLayer.getHeight() != getHeight())
+        curveLayer = Image(Image::PixelFormat::ARGB, getWidth(), getHeight(), true);
+    else
+        curveLayer.clear(curveLayer.getBounds());
+
+    Graphics g(curveLayer);
 
     g.setColour(Colour(47u, 9u, 75u));
     g.drawRoundedRectangle(getRenderArea().toFloat(), 4.f, 1.5f);
 
+    g.reduceClipRegion(getRenderArea());
     g.setColour(Colours::royalblue);
     g.strokePath(responseCurve, PathStrokeType(3.f));
-
-
 }
 
 void ResponseCurveComponent::resized() {
@@ -516,6 +908,12 @@ void ResponseCurveComponent::resized() {
         g.drawFittedText(str, r, juce::Justification::centredLeft, 1);
     }
 
+    //the grid follows the width, so the curve has to be worked out again for it
+    updateChain();
+    updateResponseCurve();
+    renderCurveLayer();
+
+    prepareWaterfall();
 }
 
 
@@ -541,25 +939,38 @@ juce::Rectangle<int> ResponseCurveComponent::getAnalysisArea() {
 }
 
 
+//looks a parameter up by its entry in the table instead of spelling out the ID
+static juce::RangedAudioParameter& lookUpParameter(CompASAudioProcessor& processor, ParameterIndex index)
+{
+    auto* param = processor.apvts.getParameter(getParameterID(index));
+    jassert(param != nullptr);
+    return *param;
+}
+
+//where the analyzer's settings are kept in the plugin state
+static const juce::Identifier analyzerOrderProperty{ "AnalyzerFFTOrder" };
+static const juce::Identifier analyzerOverlapProperty{ "AnalyzerFFTOverlap" };
+static const juce::Identifier analyzerViewProperty{ "AnalyzerView" };
+
 //add all sliders attachment in the constructor, this provides save state functionality alongside connecting dsp w slider
 CompASAudioProcessorEditor::CompASAudioProcessorEditor(CompASAudioProcessor& p)
     : AudioProcessorEditor(&p), audioProcessor(p),
-    peakFreqSlider(*audioProcessor.apvts.getParameter("Peak Freq"), "Hz"),
-    peakGainSlider(*audioProcessor.apvts.getParameter("Peak Gain"), "dB"),
-    peakQualitySlider(*audioProcessor.apvts.getParameter("Peak Quality"), ""),
-    lowCutFreqSlider(*audioProcessor.apvts.getParameter("LowCut Freq"), "Hz"),
-    highCutFreqSlider(*audioProcessor.apvts.getParameter("HighCut Freq"), "Hz"),
-    lowCutSlopeSlider(*audioProcessor.apvts.getParameter("LowCut Slope"), "dB/Oct"),
-    highCutSlopeSlider(*audioProcessor.apvts.getParameter("HighCut Slope"), "dB/Oct"),
+    peakFreqSlider(lookUpParameter(audioProcessor, Param_PeakFreq), parameterInfos[Param_PeakFreq].suffix),
+    peakGainSlider(lookUpParameter(audioProcessor, Param_PeakGain), parameterInfos[Param_PeakGain].suffix),
+    peakQualitySlider(lookUpParameter(audioProcessor, Param_PeakQuality), parameterInfos[Param_PeakQuality].suffix),
+    lowCutFreqSlider(lookUpParameter(audioProcessor, Param_LowCutFreq), parameterInfos[Param_LowCutFreq].suffix),
+    highCutFreqSlider(lookUpParameter(audioProcessor, Param_HighCutFreq), parameterInfos[Param_HighCutFreq].suffix),
+    lowCutSlopeSlider(lookUpParameter(audioProcessor, Param_LowCutSlope), parameterInfos[Param_LowCutSlope].suffix),
+    highCutSlopeSlider(lookUpParameter(audioProcessor, Param_HighCutSlope), parameterInfos[Param_HighCutSlope].suffix),
 
     responseCurveComponent(audioProcessor),
-    peakFreqSliderAttachment(audioProcessor.apvts, "Peak Freq", peakFreqSlider),
-    peakGainSliderAttachment(audioProcessor.apvts, "Peak Gain", peakGainSlider),
-    peakQualitySliderAttachment(audioProcessor.apvts, "Peak Quality", peakQualitySlider),
-    lowCutFreqSliderAttachment(audioProcessor.apvts, "LowCut Freq", lowCutFreqSlider),
-    highCutFreqSliderAttachment(audioProcessor.apvts, "HighCut Freq", highCutFreqSlider),
-    lowCutSlopeSliderAttachment(audioProcessor.apvts, "LowCut Slope", lowCutSlopeSlider),
-    highCutSlopeSliderAttachment(audioProcessor.apvts, "HighCut Slope", highCutSlopeSlider)
+    peakFreqSliderAttachment(audioProcessor.apvts, getParameterID(Param_PeakFreq), peakFreqSlider),
+    peakGainSliderAttachment(audioProcessor.apvts, getParameterID(Param_PeakGain), peakGainSlider),
+    peakQualitySliderAttachment(audioProcessor.apvts, getParameterID(Param_PeakQuality), peakQualitySlider),
+    lowCutFreqSliderAttachment(audioProcessor.apvts, getParameterID(Param_LowCutFreq), lowCutFreqSlider),
+    highCutFreqSliderAttachment(audioProcessor.apvts, getParameterID(Param_HighCutFreq), highCutFreqSlider),
+    lowCutSlopeSliderAttachment(audioProcessor.apvts, getParameterID(Param_LowCutSlope), lowCutSlopeSlider),
+    highCutSlopeSliderAttachment(audioProcessor.apvts, getParameterID(Param_HighCutSlope), highCutSlopeSlider)
 {
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
@@ -592,8 +1003,89 @@ CompASAudioProcessorEditor::CompASAudioProcessorEditor(CompASAudioProcessor& p)
         addAndMakeVisible(comp);
     }
 
+    //item ids are the FFT orders themselves
+    fftOrderBox.addItem("FFT 2048", FFTOrder::order2048);
+    fftOrderBox.addItem("FFT 4096", FFTOrder::order4096);
+    fftOrderBox.addItem("FFT 8192", FFTOrder::order8192);
+    fftOrderBox.onChange = [this]
+    {
+        const auto order = (FFTOrder)fftOrderBox.getSelectedId();
+        audioProcessor.apvts.state.setProperty(analyzerOrderProperty, (int)order, nullptr);
+        responseCurveComponent.setFFTOrder(order);
+    };
 
-    setSize (600, 400);
+    //same for the overlap, the ids are the hops per window
+    fftOverlapBox.addItem("Overlap 0%", FFTOverlap::overlapNone);
+    fftOverlapBox.addItem("Overlap 50%", FFTOverlap::overlap50);
+    fftOverlapBox.addItem("Overlap 75%", FFTOverlap::overlap75);
+    fftOverlapBox.onChange = [this]
+    {
+        const auto overlap = (FFTOverlap)fftOverlapBox.getSelectedId();
+        audioProcessor.apvts.state.setProperty(analyzerOverlapProperty, (int)overlap, nullptr);
+        responseCurveComponent.setFFTOverlap(overlap);
+    };
+
+    analyzerViewBox.addItem("L / R", AnalyzerView::View_LeftRight);
+    analyzerViewBox.addItem("Mid / Side", AnalyzerView::View_MidSide);
+    analyzerViewBox.addItem("Waterfall", AnalyzerView::View_Waterfall);
+    analyzerViewBox.onChange = [this]
+    {
+        const auto view = (AnalyzerView)analyzerViewBox.getSelectedId();
+        audioProcessor.apvts.state.setProperty(analyzerViewProperty, (int)view, nullptr);
+        responseCurveComponent.setAnalyzerView(view);
+    };
+
+    syncAnalyzerSettings();
+    audioProcessor.apvts.state.addListener(this);
+
+    //items in the same order as the parameter's choices, the attachment maps them by index
+    const auto& engineInfo = parameterInfos[Param_FilterEngine];
+    for (int i = 0; i < engineInfo.numChoices; ++i)
+        filterEngineBox.addItem(engineInfo.choices[i], i + 1);
+
+    filterEngineBoxAttachment = std::make_unique<APVTS::ComboBoxAttachment>(audioProcessor.apvts,
+        getParameterID(Param_FilterEngine), filterEngineBox);
+
+
+    setSize (600, 400 + analyzerSettingsHeight);
+}
+
+CompASAudioProcessorEditor::~CompASAudioProcessorEditor()
+{
+    audioProcessor.apvts.state.removeListener(this);
+}
+
+void CompASAudioProcessorEditor::valueTreePropertyChanged(juce::ValueTree&, const juce::Identifier& property)
+{
+    if (property == analyzerOrderProperty || property == analyzerOverlapProperty || property == analyzerViewProperty)
+        triggerAsyncUpdate();
+}
+
+void CompASAudioProcessorEditor::valueTreeRedirected(juce::ValueTree&)
+{
+    triggerAsyncUpdate();
+}
+
+void CompASAudioProcessorEditor::handleAsyncUpdate()
+{
+    syncAnalyzerSettings();
+}
+
+void CompASAudioProcessorEditor::syncAnalyzerSettings()
+{
+    const auto& state = audioProcessor.apvts.state;
+
+    //a stored id the box doesn't have (or none at all) falls back to the default
+    auto select = [&state](juce::ComboBox& box, const juce::Identifier& property, int defaultId)
+    {
+        const int id = state.getProperty(property, defaultId);
+        box.setSelectedId(box.indexOfItemId(id) >= 0 ? id : defaultId, juce::dontSendNotification);
+        return box.getSelectedId();
+    };
+
+    responseCurveComponent.setFFTOrder((FFTOrder)select(fftOrderBox, analyzerOrderProperty, FFTOrder::order2048));
+    responseCurveComponent.setFFTOverlap((FFTOverlap)select(fftOverlapBox, analyzerOverlapProperty, FFTOverlap::overlap50));
+    responseCurveComponent.setAnalyzerView((AnalyzerView)select(analyzerViewBox, analyzerViewProperty, AnalyzerView::View_LeftRight));
 }
 
 //==============================================================================
@@ -616,12 +1108,19 @@ void CompASAudioProcessorEditor::resized()
     //bound area
     auto bounds = getLocalBounds();
 
+    //the analyzer settings get a strip of their own above the display, so they don't cover its labels or frame
+    auto analyzerSettingsArea = bounds.removeFromTop(analyzerSettingsHeight);
+
     float hRatio = 30.f / 100.f; // JUCE_LIVE_CONSTANT(33) / 100.f;
     //remove 33% top
     auto responseArea = bounds.removeFromTop(bounds.getHeight() * hRatio);
 
     responseCurveComponent.setBounds(responseArea);
     bounds.removeFromTop(5);
+
+    fftOrderBox.setBounds(analyzerSettingsArea.removeFromRight(110).reduced(2));
+    fftOverlapBox.setBounds(analyzerSettingsArea.removeFromRight(110).reduced(2));
+    analyzerViewBox.setBounds(analyzerSettingsArea.removeFromRight(110).reduced(2));
     
     auto lowCutArea = bounds.removeFromLeft(bounds.getWidth()*0.33);
     auto highCutArea = bounds.removeFromRight(bounds.getWidth()*0.5);
@@ -634,6 +1133,8 @@ void CompASAudioProcessorEditor::resized()
     highCutFreqSlider.setBounds(highCutArea.removeFromTop(highCutArea.getHeight() * 0.5));
     highCutSlopeSlider.setBounds(highCutArea);
 
+    filterEngineBox.setBounds(bounds.removeFromBottom(24).reduced(bounds.getWidth() / 6, 2));
+
     peakFreqSlider.setBounds(bounds.removeFromTop(bounds.getHeight() * 0.33));
     peakGainSlider.setBounds(bounds.removeFromTop(bounds.getHeight() * 0.5));
     peakQualitySlider.setBounds(bounds);
@@ -650,6 +1151,10 @@ std::vector<juce::Component*> CompASAudioProcessorEditor::getComps() {
         &highCutFreqSlider,
         &lowCutSlopeSlider,
         &highCutSlopeSlider,
-        &responseCurveComponent
+        &responseCurveComponent,
+        &fftOrderBox,
+        &fftOverlapBox,
+        &analyzerViewBox,
+        &filterEngineBox
     };
 }
@@ -10,6 +10,8 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "HalfBandDecimator.h"
+#include "HeapCounter.h"
 
 //fft functions
 
@@ -20,104 +22,248 @@ enum FFTOrder
     order8192 = 13
 };
 
-template<typename BlockType>
+//how far the analysis window moves between FFTs, as a fraction of the FFT size
+enum FFTOverlap
+{
+    overlapNone = 1,
+    overlap50 = 2,
+    overlap75 = 4
+};
+
+//scales the magnitudes and turns them into decibels, clamped at negativeInfinity. log2 comes from the exponent
+//bits plus a 4th order polynomial over the mantissa, good to about 1e-4 in log2 (under 0.001dB). inf/nan count
+//as silence. the bulk goes through SIMDRegister, the unaligned ends (and builds without SIMD) use the scalar one
+struct FastDecibels
+{
+    static constexpr float decibelsPerOctave = 6.0205999f; //20 * log10(2)
+    static constexpr float c1 = 1.4390145f, c2 = -0.6799429f, c3 = 0.3255936f, c4 = -0.0847676f;
+
+    //clamping the gain before the log is the same as clamping the decibels after it
+    static float getFloorGain(float negativeInfinity)
+    {
+        return std::max(juce::Decibels::decibelsToGain(negativeInfinity, -1000.f), 1.0e-30f);
+    }
+
+    static float fromGain(float v, float floorGain)
+    {
+        v = std::abs(v);
+        //inf and nan both fail this
+        v = v < std::numeric_limits<float>::infinity() ? v : 0.f;
+        v = std::max(v, floorGain);
+
+        juce::uint32 bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+
+        const auto exponent = (float)((int)(bits >> 23) - 127);
+
+        const juce::uint32 mantissaBits = (bits & 0x007fffffu) | 0x3f800000u;
+        float mantissa;
+        std::memcpy(&mantissa, &mantissaBits, sizeof(mantissa));
+
+        const auto x = mantissa - 1.f;
+        const auto log2Mantissa = x * (c1 + x * (c2 + x * (c3 + x * c4)));
+
+        return decibelsPerOctave * (exponent + log2Mantissa);
+    }
+
+   #if JUCE_USE_SIMD && (JUCE_INTEL || JUCE_ARM)
+    using Floats = juce::dsp::SIMDRegister<float>;
+    using Bits = Floats::vMaskType;
+
+    //SIMDRegister has no bit casts, shifts or int to float conversion, these go through the native types.
+    //overloaded on them so whichever register width juce picked gets used
+   #if JUCE_INTEL
+    static __m128i toBits(__m128 v) { return _mm_castps_si128(v); }
+    static __m128 toFloats(__m128i v) { return _mm_castsi128_ps(v); }
+    static __m128 exponentField(__m128i v) { return _mm_cvtepi32_ps(_mm_srli_epi32(v, 23)); }
+    #if defined(__AVX2__)
+    static __m256i toBits(__m256 v) { return _mm256_castps_si256(v); }
+    static __m256 toFloats(__m256i v) { return _mm256_castsi256_ps(v); }
+    static __m256 exponentField(__m256i v) { return _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 23)); }
+    #endif
+   #else
+    static uint32x4_t toBits(float32x4_t v) { return vreinterpretq_u32_f32(v); }
+    static float32x4_t toFloats(uint32x4_t v) { return vreinterpretq_f32_u32(v); }
+    static float32x4_t exponentField(uint32x4_t v) { return vcvtq_f32_u32(vshrq_n_u32(v, 23)); }
+   #endif
+
+    static Floats fromGain(Floats v, Floats floorGain)
+    {
+        v = v & Bits::expand(0x7fffffffu);
+        //inf and nan both fail this, the false lanes mask to 0
+        v = v & Floats::lessThan(v, Floats::expand(std::numeric_limits<float>::infinity()));
+        v = Floats::max(v, floorGain);
+
+        const auto bits = Bits::fromNative(toBits(v.value));
+        const auto exponent = Floats::fromNative(exponentField(bits.value)) - Floats::expand(127.f);
+
+        const auto mantissaBits = (bits & Bits::expand(0x007fffffu)) | Bits::expand(0x3f800000u);
+        const auto x = Floats::fromNative(toFloats(mantissaBits.value)) - Floats::expand(1.f);
+        const auto log2Mantissa = x * (Floats::expand(c1) + x * (Floats::expand(c2) + x * (Floats::expand(c3) + x * Floats::expand(c4))));
+
+        return (exponent + log2Mantissa) * Floats::expand(decibelsPerOctave);
+    }
+   #endif
+};
+
+inline void magnitudesToDecibels(float* data, int numBins, float scale, float negativeInfinity)
+{
+    const auto floorGain = FastDecibels::getFloorGain(negativeInfinity);
+    int i = 0;
+
+   #if JUCE_USE_SIMD && (JUCE_INTEL || JUCE_ARM)
+    using Floats = FastDecibels::Floats;
+    constexpr auto width = (int)Floats::SIMDNumElements;
+
+    const auto head = juce::jmin(numBins, (int)(Floats::getNextSIMDAlignedPtr(data) - data));
+    for (; i < head; ++i)
+        data[i] = FastDecibels::fromGain(data[i] * scale, floorGain);
+
+    const auto scales = Floats::expand(scale), floors = Floats::expand(floorGain);
+    for (; i + width <= numBins; i += width)
+        FastDecibels::fromGain(Floats::fromRawArray(data + i) * scales, floors).copyToRawArray(data + i);
+   #endif
+
+    for (; i < numBins; ++i)
+        data[i] = FastDecibels::fromGain(data[i] * scale, floorGain);
+}
+
+//where each spectrum sits in a frame, every one of them is fftSize / 2 bins long
+enum AnalyzerSpectrum
+{
+    Spectrum_Left,
+    Spectrum_Right,
+    Spectrum_Mid,
+    Spectrum_Side,
+
+    Spectrum_Count
+};
+
 struct FFTDataGenerator
 {
     /**
      produces the FFT data from an audio buffer.
+     left and right go through a single complex FFT as x = l + jr. both are real, so their spectra are the
+     conjugate symmetric and antisymmetric parts of X: L[k] = (X[k] + X*[N-k]) / 2, R[k] = (X[k] - X*[N-k]) / 2j.
+     mid and side are (L + R) / 2 and (L - R) / 2 of those, four spectra for the price of one transform.
+     a mono buffer is analysed as if both channels were the same.
+     fftData has to have room for getFFTSize() / 2 * Spectrum_Count values, the frame is written straight into it
      */
-    void produceFFTDataForRendering(const juce::AudioBuffer<float>& audioData, const float negativeInfinity)
+    void produceFFTDataForRendering(const juce::AudioBuffer<float>& audioData, const float negativeInfinity, float* fftData)
     {
         const auto fftSize = getFFTSize();
+        const auto numBins = fftSize / 2;
 
-        fftData.assign(fftData.size(), 0);
-        auto* readIndex = audioData.getReadPointer(0);
-        std::copy(readIndex, readIndex + fftSize, fftData.begin());
+        auto* left = audioData.getReadPointer(0);
+        auto* right = audioData.getReadPointer(audioData.getNumChannels() > 1 ? 1 : 0);
 
-        // first apply a windowing function to our data
-        window->multiplyWithWindowingTable(fftData.data(), fftSize);       // [1]
+        // first apply a windowing function to our data, packing both channels as we go
+        for (int i = 0; i < fftSize; ++i)
+            timeData[(size_t)i] = { left[i] * windowTable[(size_t)i], right[i] * windowTable[(size_t)i] };
 
         // then render our FFT data..
-        forwardFFT->performFrequencyOnlyForwardTransform(fftData.data());  // [2]
+        forwardFFT->perform(timeData.data(), frequencyData.data(), false);
 
-        int numBins = (int)fftSize / 2;
+        auto* leftMagnitudes = fftData + Spectrum_Left * numBins;
+        auto* rightMagnitudes = fftData + Spectrum_Right * numBins;
+        auto* midMagnitudes = fftData + Spectrum_Mid * numBins;
+        auto* sideMagnitudes = fftData + Spectrum_Side * numBins;
 
-        //normalize the fft values.
-        for (int i = 0; i < numBins; ++i)
+        for (int k = 0; k < numBins; ++k)
         {
-            auto v = fftData[i];
-            //            fftData[i] /= (float) numBins;
-            if (!std::isinf(v) && !std::isnan(v))
-            {
-                v /= float(numBins);
-            }
-            else
-            {
-                v = 0.f;
-            }
-            fftData[i] = v;
-        }
+            const auto z = frequencyData[(size_t)k];
+            const auto mirrored = std::conj(frequencyData[(size_t)((fftSize - k) & (fftSize - 1))]);
 
-        //convert them to decibels
-        for (int i = 0; i < numBins; ++i)
-        {
-            fftData[i] = juce::Decibels::gainToDecibels(fftData[i], negativeInfinity);
+            const auto l = (z + mirrored) * 0.5f;
+            const auto r = (z - mirrored) * juce::dsp::Complex<float>(0.f, -0.5f);
+
+            leftMagnitudes[k] = std::sqrt(std::norm(l));
+            rightMagnitudes[k] = std::sqrt(std::norm(r));
+            midMagnitudes[k] = std::sqrt(std::norm(l + r)) * 0.5f;
+            sideMagnitudes[k] = std::sqrt(std::norm(l - r)) * 0.5f;
         }
 
-        fftDataFifo.push(fftData);
+        //normalize the fft values and convert them to decibels, all four spectra at once
+        magnitudesToDecibels(fftData, numBins * Spectrum_Count, 1.f / float(numBins), negativeInfinity);
     }
 
+    //allocates, so it belongs on the analyzer thread (or before it starts), never the message or audio thread
     void changeOrder(FFTOrder newOrder)
     {
-        //when you change order, recreate the window, forwardFFT, fifo, fftData
-        //also reset the fifoIndex
-        //things that need recreating should be created on the heap via std::make_unique<>
+        //the new FFT and window are fully built before anything is touched, then go in together
+        const auto fftSize = (size_t)1 << newOrder;
 
-        order = newOrder;
-        auto fftSize = getFFTSize();
+        auto newFFT = std::make_unique<juce::dsp::FFT>(newOrder);
+        std::vector<float> newWindowTable(fftSize);
+        juce::dsp::WindowingFunction<float>::fillWindowingTables(newWindowTable.data(), fftSize,
+            juce::dsp::WindowingFunction<float>::blackmanHarris, true);
 
-        forwardFFT = std::make_unique<juce::dsp::FFT>(order);
-        window = std::make_unique<juce::dsp::WindowingFunction<float>>(fftSize, juce::dsp::WindowingFunction<float>::blackmanHarris);
-
-        fftData.clear();
-        fftData.resize(fftSize * 2, 0);
+        order = newOrder;
+        forwardFFT = std::move(newFFT);
+        windowTable = std::move(newWindowTable);
 
-        fftDataFifo.prepare(fftData.size());
+        timeData.assign(fftSize, {});
+        frequencyData.assign(fftSize, {});
     }
     //==============================================================================
+    FFTOrder getOrder() const { return order; }
     int getFFTSize() const { return 1 << order; }
-    int getNumAvailableFFTDataBlocks() const { return fftDataFifo.getNumAvailableForReading(); }
-    //==============================================================================
-    bool getFFTData(BlockType& fftData) { return fftDataFifo.pull(fftData); }
 private:
     FFTOrder order;
-    BlockType fftData;
     std::unique_ptr<juce::dsp::FFT> forwardFFT;
-    std::unique_ptr<juce::dsp::WindowingFunction<float>> window;
+    std::vector<float> windowTable;
+    std::vector<juce::dsp::Complex<float>> timeData, frequencyData;
+};
 
-    Fifo<BlockType> fftDataFifo;
+//one spectrum for the path generator, binWidth says which frequencies its bins stand for
+struct SpectrumView
+{
+    const float* data;
+    float binWidth;
 };
 
 template<typename PathType>
 struct AnalyzerPathGenerator
 {
+    //a path and how many coordinates it already has room for, they go round the pool together
+    struct PooledPath
+    {
+        PathType path;
+        int reservedCoordinates = 0;
+    };
+
     /*
-     converts 'renderData[]' into a juce::Path
+     converts the spectra into a juce::Path.
+     the first one is at the full rate, any after it are decimated copies with narrower bins. each pixel column is
+     drawn from the finest spectrum that covers it, a decimated one only counts up to half its band (fftSize / 4
+     bins) since the decimator is only flat that far
      */
-    void generatePath(const std::vector<float>& renderData,
+    void generatePath(const SpectrumView* spectra,
+        int numSpectra,
         juce::Rectangle<float> fftBounds,
         int fftSize,
-        float binWidth,
         float negativeInfinity)
     {
         auto top = fftBounds.getY();
         auto bottom = fftBounds.getHeight();
         auto width = fftBounds.getWidth();
 
-        int numBins = (int)fftSize / 2;
+        //drawn straight into the next free slot, clear() keeps the storage from last time round
+        auto* slot = pathFifo.beginWrite();
+        if (slot == nullptr)
+            return;
+
+        auto& p = slot->path;
+        p.clear();
 
-        PathType p;
-        p.preallocateSpace(3 * (int)fftBounds.getWidth());
+        //three coordinates per vertex, one vertex per column plus the start. a path only grows the first time
+        //it comes round after the width did, never while it's being drawn
+        const auto coordinatesNeeded = 3 * ((int)width + 2);
+        if (slot->reservedCoordinates < coordinatesNeeded)
+        {
+            p.preallocateSpace(coordinatesNeeded);
+            slot->reservedCoordinates = coordinatesNeeded;
+        }
 
         auto map = [bottom, top, negativeInfinity](float v)
         {
@@ -126,7 +272,7 @@ struct AnalyzerPathGenerator
                 float(bottom + 10), top);
         };
 
-        auto y = map(renderData[0]);
+        auto y = map(spectra[0].data[0]);
 
         //        jassert( !std::isnan(y) && !std::isinf(y) );
         if (std::isnan(y) || std::isinf(y))
@@ -134,24 +280,88 @@ struct AnalyzerPathGenerator
 
         p.startNewSubPath(0, y);
 
-        const int pathResolution = 2; //you can draw line-to's every 'pathResolution' pixels.
+        updateColumnMap(spectra, numSpectra, fftSize, (int)width);
 
-        for (int binNum = 1; binNum < numBins; binNum += pathResolution)
+        //columns no bin lands in are left to the line between neighbours
+        forEachColumnPeak(spectra, [&p, &map](int column, float peak)
         {
-            y = map(renderData[binNum]);
-
-            //            jassert( !std::isnan(y) && !std::isinf(y) );
+            const auto y = map(peak);
 
             if (!std::isnan(y) && !std::isinf(y))
+                p.lineTo((float)column, y);
+        });
+
+        pathFifo.finishWrite();
+    }
+
+    /*
+     one waterfall row from the same spectra: every column's peak as a byte, 0 at negativeInfinity and 255 at 0dB.
+     columns no bin lands in are filled in along the straight line between their neighbours, like the path does
+     */
+    void generateRow(const SpectrumView* spectra,
+        int numSpectra,
+        juce::Rectangle<float> fftBounds,
+        int fftSize,
+        float negativeInfinity)
+    {
+        const auto width = juce::jmax((int)fftBounds.getWidth(), 0);
+        updateColumnMap(spectra, numSpectra, fftSize, width);
+
+        auto* slot = rowFifo.beginWrite();
+        if (slot == nullptr)
+            return;
+
+        auto& row = *slot;
+
+        //rows swap round between the slots and the gui like the paths do, they only grow after the width did
+        row.resize((size_t)width);
+
+        const auto scale = 255.f / -negativeInfinity;
+        auto previousColumn = -1;
+        auto previousLevel = 0.f;
+
+        forEachColumnPeak(spectra, [&](int column, float peak)
+        {
+            const auto level = juce::jlimit(0.f, 255.f, (peak - negativeInfinity) * scale);
+
+            for (int gap = previousColumn + 1; gap < column; ++gap)
             {
-                auto binFreq = binNum * binWidth;
-                auto normalizedBinX = juce::mapFromLog10(binFreq, 20.f, 20000.f);
-                int binX = std::floor(normalizedBinX * width);
-                p.lineTo(binX, y);
+                const auto t = previousColumn < 0 ? 1.f : float(gap - previousColumn) / float(column - previousColumn);
+                row[(size_t)gap] = (juce::uint8)(previousLevel + t * (level - previousLevel));
             }
-        }
 
-        pathFifo.push(p);
+            row[(size_t)column] = (juce::uint8)level;
+            previousColumn = column;
+            previousLevel = level;
+        });
+
+        for (int gap = previousColumn + 1; gap < width; ++gap)
+            row[(size_t)gap] = (juce::uint8)previousLevel;
+
+        keepLastRow(row);
+        rowFifo.finishWrite();
+    }
+
+    //the last row once more, for audio that never got as far as an FFT. the floor if there's no row at this width yet
+    void repeatRow(juce::Rectangle<float> fftBounds)
+    {
+        const auto width = juce::jmax((int)fftBounds.getWidth(), 0);
+
+        auto* slot = rowFifo.beginWrite();
+        if (slot == nullptr)
+            return;
+
+        if (lastRow.size() != (size_t)width)
+            lastRow.assign((size_t)width, 0);
+
+        slot->assign(lastRow.begin(), lastRow.end());
+        rowFifo.finishWrite();
+    }
+
+    //whether the gui has left room for another row
+    bool canTakeRow() const
+    {
+        return rowFifo.getFreeSpace() > 0;
     }
 
     int getNumPathsAvailable() const
@@ -159,12 +369,122 @@ struct AnalyzerPathGenerator
         return pathFifo.getNumAvailableForReading();
     }
 
-    bool getPath(PathType& path)
+    //swaps the finished path in, the one handed over goes back into the pool
+    bool getPath(PooledPath& path)
     {
         return pathFifo.pull(path);
     }
+
+    //same swap as getPath(), the vector handed over is reused for a later row
+    bool getRow(std::vector<juce::uint8>& row)
+    {
+        return rowFifo.pull(row);
+    }
+
+    //paths and rows drawn so far
+    int getNumDrawn() const { return pathFifo.getNumWrittenFrames() + rowFifo.getNumWrittenFrames(); }
+    //after a change of width, how many have to be drawn before every path and row going round has been sized for it.
+    //a slot is drawn into again at most a lap after the gui swapped it in, so two laps of the bigger fifo
+    int getNumWarmUpDrawings() const { return 2 * juce::jmax(pathFifo.getCapacity(), rowFifo.getCapacity()); }
 private:
-    Fifo<PathType> pathFifo;
+    //one slot being drawn while the other waits for the gui, that's all the buffering needed.
+    //together with the path the gui holds, these are the only paths a trace ever uses
+    Fifo<PooledPath> pathFifo{ 3 };
+    //waterfall rows, one per hop. the gui takes all of them every frame, this is room for a few frames of the
+    //smallest hop at the slowest frame rate, anything beyond that waits in the taps until there's room again
+    Fifo<std::vector<juce::uint8>> rowFifo{ 32 };
+    //a copy of the newest row, for repeatRow()
+    std::vector<juce::uint8> lastRow;
+
+    void keepLastRow(const std::vector<juce::uint8>& row)
+    {
+        lastRow.assign(row.begin(), row.end());
+    }
+
+    //at the top end hundreds of bins share a pixel column, only the loudest of them can be seen anyway,
+    //so every column gets one value at most. columns no bin lands in are skipped
+    template<typename Callback>
+    void forEachColumnPeak(const SpectrumView* spectra, Callback&& callback) const
+    {
+        for (int column = 0; column < (int)columns.size(); ++column)
+        {
+            const auto& bins = columns[(size_t)column];
+
+            if (bins.firstBin == bins.lastBin)
+                continue;
+
+            const auto* renderData = spectra[bins.spectrum].data;
+            const auto firstBin = bins.firstBin;
+            const auto lastBin = bins.lastBin;
+
+            auto peak = renderData[firstBin];
+            for (int binNum = firstBin + 1; binNum < lastBin; ++binNum)
+                peak = std::max(peak, renderData[binNum]);
+
+            callback(column, peak);
+        }
+    }
+
+    //bins [firstBin, lastBin) of one of the spectra all land in the column
+    struct ColumnBins
+    {
+        int spectrum = 0;
+        int firstBin = 0, lastBin = 0;
+    };
+
+    std::vector<ColumnBins> columns;
+    std::vector<int> columnFirstBin;
+    int mappedFFTSize = 0, mappedWidth = 0, mappedNumSpectra = 0;
+    float mappedBinWidth = 0.f;
+
+    //the log mapping only changes with the FFT size, the sample rate or the width, not from frame to frame
+    void updateColumnMap(const SpectrumView* spectra, int numSpectra, int fftSize, int width)
+    {
+        const auto binWidth = spectra[0].binWidth;
+
+        if (fftSize == mappedFFTSize && binWidth == mappedBinWidth && width == mappedWidth && numSpectra == mappedNumSpectra)
+            return;
+
+        mappedFFTSize = fftSize;
+        mappedBinWidth = binWidth;
+        mappedWidth = width;
+        mappedNumSpectra = numSpectra;
+
+        width = juce::jmax(width, 0);
+        const int numBins = fftSize / 2;
+
+        columns.assign((size_t)width, {});
+        columnFirstBin.resize((size_t)width + 1);
+
+        for (int spectrum = 0; spectrum < numSpectra; ++spectrum)
+        {
+            const auto spectrumBinWidth = spectra[spectrum].binWidth;
+
+            //bins below 20Hz map to negative columns and are skipped, bins past the right edge are never reached
+            int binNum = 1;
+            for (int column = 0; column <= width; ++column)
+            {
+                while (binNum < numBins
+                    && std::floor(juce::mapFromLog10(binNum * spectrumBinWidth, 20.f, 20000.f) * width) < column)
+                {
+                    ++binNum;
+                }
+
+                columnFirstBin[(size_t)column] = binNum;
+            }
+
+            //finer spectra come later, so they take over every column whose centre they cover
+            const auto topFrequency = spectrum == 0 ? std::numeric_limits<float>::max() : spectrumBinWidth * fftSize / 4.f;
+
+            for (int column = 0; column < width; ++column)
+            {
+                const auto centreFrequency = juce::mapToLog10((column + 0.5f) / (float)width, 20.f, 20000.f);
+
+                if (centreFrequency < topFrequency)
+                    columns[(size_t)column] = { spectrum, columnFirstBin[(size_t)column], columnFirstBin[(size_t)column + 1] };
+            }
+        }
+    }
 };
 
 //define a datastructure for all our sliders once - : is used to initialize constructors and for inheritance
@@ -217,26 +537,370 @@ private:
 
 //for our GUI
 
+//what the analyzer draws, both traces come out of the same transform either way
+enum AnalyzerView
+{
+    View_LeftRight = 1,
+    View_MidSide,
+    //mid over time instead of two traces
+    View_Waterfall
+};
+
 struct PathProducer
 {
-    PathProducer(SingleChannelSampleFifo<CompASAudioProcessor::BlockType>& scsf) :
-        leftChannelFifo(&scsf)
+    //the full rate plus three decimated copies, all with the same FFT size
+    static constexpr int numLevels = 4;
+
+    PathProducer(SingleChannelSampleFifo<CompASAudioProcessor::BlockType>& left,
+        SingleChannelSampleFifo<CompASAudioProcessor::BlockType>& right) :
+        channelFifos{ &left, &right }
     {
-        leftChannelFFTDataGenerator.changeOrder(FFTOrder::order2048);
-        monoBuffer.setSize(1, leftChannelFFTDataGenerator.getFFTSize());
+        changeOrder(FFTOrder::order2048);
     }
+    //analyzer thread: turns whatever audio has arrived into spectra and finished paths
     void process(juce::Rectangle<float> fftBounds, double sampleRate);
-    juce::Path getPath() { return leftChannelFFTPath; }
+    //message thread: swaps the newest finished paths in, false if there weren't any.
+    //with the input quiet the analyzer stops making paths, so this stays false and nothing needs repainting
+    bool updatePaths();
+    //0 is left (or mid), 1 is right (or side). stays valid until the next updatePaths()
+    const juce::Path& getPath(int trace) const { return tracePaths[(size_t)trace].path; }
+    //message thread, waterfall view: the oldest row not taken yet, swapped into row
+    bool getWaterfallRow(std::vector<juce::uint8>& row) { return pathGenerators[0].getRow(row); }
+
+    //safe to call from the message thread while the analyzer runs
+    void setOverlap(FFTOverlap newOverlap) { overlap.store((int)newOverlap); }
+    //same, the analyzer thread picks the new order up at the start of its next pass
+    void setOrder(FFTOrder newOrder) { requestedOrder.store((int)newOrder); }
+    void setView(AnalyzerView newView) { view.store((int)newView); }
 private:
-    SingleChannelSampleFifo<CompASAudioProcessor::BlockType>* leftChannelFifo;
+    static constexpr int numTraces = 2;
+    static constexpr float negativeInfinity = -48.f;
+
+    std::array<SingleChannelSampleFifo<CompASAudioProcessor::BlockType>*, numTraces> channelFifos;
+
+    //level n runs at sampleRate / 2^n, fed by its decimators from level n - 1. with the same FFT size its bins
+    //are 2^n times narrower, so the low end gets fine detail for the price of a few small transforms,
+    //while the top end keeps the short window of the full rate level
+    struct AnalysisLevel
+    {
+        //the newest fftSize samples of both channels at this level's rate
+        juce::AudioBuffer<float> windowBuffer;
+        FFTDataGenerator fftDataGenerator;
+        std::array<AnalyzerLevelDecimator, numTraces> decimators;
+        //the newest frame, this level's part of the spectrum arena
+        float* spectra = nullptr;
+        //how much has come in since this level's last FFT
+        int pendingSamples = 0;
+    };
+
+    std::array<AnalysisLevel, numLevels> levels;
+
+    //every level's spectra in one block, only reallocated when the FFT order grows past anything seen before
+    std::vector<float> spectrumArena;
+
+    //sessions above 48k are halved (up to three times) before they reach the full rate level, which so always
+    //runs at 44.1 or 48k. the FFT then covers the audible band, and its cost and resolution don't depend on the session rate
+    static constexpr int maxSampleRateStages = 3;
+    std::array<std::array<SampleRateDecimator, numTraces>, maxSampleRateStages> sampleRateDecimators;
+    int numSampleRateStages = 0;
+    double preparedSampleRate = 0.0;
+    //raw audio on its way through those stages
+    juce::AudioBuffer<float> incomingBuffer;
+
+    std::array<AnalyzerPathGenerator<juce::Path>, numTraces> pathGenerators;
+
+    //the paths the gui is showing, each one swaps back into its generator's pool for the next
+    std::array<AnalyzerPathGenerator<juce::Path>::PooledPath, numTraces> tracePaths;
+
+    std::atomic<int> overlap{ FFTOverlap::overlap50 };
+    std::atomic<int> requestedOrder{ FFTOrder::order2048 };
+    std::atomic<int> view{ AnalyzerView::View_LeftRight };
+
+    //how long (at the full rate level) the input has stayed below quietLevel, and what the last paths or row were drawn for.
+    //once the quiet covers every level's window the spectra can't change any more, so neither can the paths or the row
+    static constexpr float quietLevel = 1.0e-5f;
+    int quietSamples = 0;
+    juce::Rectangle<float> pathBounds;
+    int pathView = 0;
+
+    //waterfall view: tap samples that were dropped and haven't been made up for with rows yet, and the taps'
+    //dropped count as of the last pass
+    int missedSamples = 0;
+    int lastDroppedSamples = 0;
+
+    //what everything is sized from as of the last pass, and how much had been drawn when any of it last changed.
+    //with all of it left alone for a warm-up the analyzer mustn't go to the heap any more, process() checks that
+    int sizedOrder = 0, sizedView = 0, sizedWidth = -1;
+    double sizedSampleRate = 0.0;
+    int drawnWhenSized = 0;
+    bool isSteady(juce::Rectangle<float> fftBounds, double sampleRate);
+
+    void processFrame(juce::Rectangle<float> fftBounds, double sampleRate);
+    void changeOrder(FFTOrder newOrder);
+    void prepareSampleRateStages(double sampleRate);
+    void processWaterfall(juce::Rectangle<float> fftBounds, double sampleRate, int hopSize, int available);
+    //pulls rawNewSamples from the taps through the rate stages into the end of the full rate window,
+    //returns how many samples that came to there
+    int readHops(int rawNewSamples);
+    //the full rate level's FFT, then the new samples on down the levels, each running its FFT once it has a hop
+    void analyseLevels(int newSamples, int hopSize);
+    //counts the new samples into the quiet stretch, true once every level's spectra are down at the floor
+    bool isSettledQuiet(int newSamples, int hopSize);
+    void analyseLevel(AnalysisLevel& level);
+    std::array<SpectrumView, numLevels> getSpectra(int spectrum, double sampleRate) const;
+};
+
+//runs the FFTs and builds the analyzer paths off the message thread.
+//the timer hands it the current geometry once per frame and picks the finished paths up on the next one
+struct AnalyzerThread : juce::Thread
+{
+    AnalyzerThread(PathProducer& producer) :
+        juce::Thread("Analyzer"),
+        pathProducer(producer)
+    {
+    }
+
+    ~AnalyzerThread() override
+    {
+        stopThread(1000);
+    }
+
+    void requestFrame(juce::Rectangle<float> fftBounds, double sampleRate)
+    {
+        {
+            const juce::SpinLock::ScopedLockType lock(frameLock);
+            requestedBounds = fftBounds;
+            requestedSampleRate = sampleRate;
+        }
+
+        notify();
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            wait(-1);
 
-    juce::AudioBuffer<float> monoBuffer;
+            if (threadShouldExit())
+                break;
 
-    FFTDataGenerator<std::vector<float>> leftChannelFFTDataGenerator;
+            juce::Rectangle<float> fftBounds;
+            double sampleRate;
+            {
+                const juce::SpinLock::ScopedLockType lock(frameLock);
+                fftBounds = requestedBounds;
+                sampleRate = requestedSampleRate;
+            }
+
+            pathProducer.process(fftBounds, sampleRate);
+        }
+    }
 
-    AnalyzerPathGenerator<juce::Path> pathProducer;
+private:
+    PathProducer& pathProducer;
 
-    juce::Path leftChannelFFTPath;
+    juce::SpinLock frameLock;
+    juce::Rectangle<float> requestedBounds;
+    double requestedSampleRate = 44100.0;
+};
+
+//the chain's response on a log frequency grid, one point per pixel column, kept in decibels one stage at a time.
+//a knob only touches its own stage, so only that stage is evaluated again and the curve is the sum of the three
+struct ResponseCurveCache
+{
+    enum Stage
+    {
+        Stage_LowCut,
+        Stage_Peak,
+        Stage_HighCut,
+
+        Stage_Count
+    };
+
+    //a new width or sample rate moves every point, true if it did and every stage has to be set again
+    bool prepare(int newNumPoints, double newSampleRate)
+    {
+        if (newNumPoints == numPoints && newSampleRate == sampleRate)
+            return false;
+
+        numPoints = juce::jmax(newNumPoints, 0);
+        sampleRate = newSampleRate;
+
+        //|b0 + b1 e^-jw + b2 e^-j2w|^2 can be written in terms of sin^2(w / 2) alone, that's all the grid needs to keep.
+        //worked out in double, the low end is where the cut filters need the precision
+        sinSquared.resize((size_t)numPoints);
+        for (int i = 0; i < numPoints; ++i)
+        {
+            const auto freq = juce::mapToLog10(double(i) / double(numPoints), 20.0, 20000.0);
+            const auto halfOmega = juce::MathConstants<double>::pi * juce::jlimit(0.0, 0.5, freq / sampleRate);
+            sinSquared[(size_t)i] = (float)(std::sin(halfOmega) * std::sin(halfOmega));
+        }
+
+        for (auto& stage : stageDecibels)
+            stage.assign((size_t)numPoints, 0.f);
+
+        power.resize((size_t)numPoints);
+        decibels.assign((size_t)numPoints, 0.f);
+        decibelsValid = true;
+
+        return true;
+    }
+
+    //evaluates the stage's sections over the whole grid, an inactive stage is flat
+    void setStage(Stage stage, const BiquadCoefficients* sections, int numSections, bool active)
+    {
+        auto* stageData = stageDecibels[(size_t)stage].data();
+        decibelsValid = false;
+
+        if (!active || numSections == 0)
+        {
+            juce::FloatVectorOperations::clear(stageData, numPoints);
+            return;
+        }
+
+        juce::FloatVectorOperations::fill(power.data(), 1.f, numPoints);
+
+        for (int s = 0; s < numSections; ++s)
+            multiplyBySectionPower(power.data(), sections[s]);
+
+        //magnitudesToDecibels gives 20log10, halving that gives the 10log10 a power needs
+        magnitudesToDecibels(power.data(), numPoints, 1.f, floorDecibels);
+        juce::FloatVectorOperations::multiply(stageData, power.data(), 0.5f, numPoints);
+    }
+
+    //the whole chain in dB, only added up again after a stage changed
+    const std::vector<float>& getDecibels()
+    {
+        if (!decibelsValid)
+        {
+            juce::FloatVectorOperations::add(decibels.data(), stageDecibels[Stage_LowCut].data(),
+                stageDecibels[Stage_Peak].data(), numPoints);
+            juce::FloatVectorOperations::add(decibels.data(), stageDecibels[Stage_HighCut].data(), numPoints);
+            decibelsValid = true;
+        }
+
+        return decibels;
+    }
+
+private:
+    //far below anything drawn, only there so a zero of the response doesn't turn into -inf
+    static constexpr float floorDecibels = -600.f;
+
+    int numPoints = 0;
+    double sampleRate = 0.0;
+
+    std::vector<float> sinSquared;
+    std::array<std::vector<float>, Stage_Count> stageDecibels;
+    std::vector<float> power, decibels;
+    bool decibelsValid = true;
+
+    //with p = sin^2(w / 2): |b0 + b1 z^-1 + b2 z^-2|^2 = (b0 + b1 + b2)^2 - 4(b0b1 + 4b0b2 + b1b2)p + 16b0b2p^2.
+    //unlike the cos(w) form it doesn't cancel near dc, so floats are fine per point once the three terms are
+    //worked out in double. written as a plain loop over the grid so the compiler can vectorize it
+    void multiplyBySectionPower(float* data, const BiquadCoefficients& c) const
+    {
+        auto terms = [](double x0, double x1, double x2)
+        {
+            return std::array<float, 3>{ (float)((x0 + x1 + x2) * (x0 + x1 + x2)),
+                (float)(-4.0 * (x0 * x1 + 4.0 * x0 * x2 + x1 * x2)),
+                (float)(16.0 * x0 * x2) };
+        };
+
+        const auto b = terms(c[0], c[1], c[2]);
+        const auto a = terms(1.0, c[3], c[4]);
+        const auto* p = sinSquared.data();
+
+        for (int i = 0; i < numPoints; ++i)
+        {
+            const auto numerator = b[0] + p[i] * (b[1] + p[i] * b[2]);
+            const auto denominator = a[0] + p[i] * (a[1] + p[i] * a[2]);
+            data[i] *= numerator / denominator;
+        }
+    }
+};
+
+//the waterfall's memory, one row per analyzer frame and one byte per pixel column, newest first.
+//a byte is plenty to pick a colour with and keeps a screen's worth of history to a couple of hundred kB
+struct WaterfallHistory
+{
+    //a new width makes the old rows meaningless, so this starts over
+    void prepare(int newWidth, int newNumRows)
+    {
+        width = juce::jmax(newWidth, 0);
+        numRows = juce::jmax(newNumRows, 1);
+        rows.assign((size_t)(width * numRows), 0);
+        newestRow = 0;
+        numStored = 0;
+    }
+
+    void push(const std::vector<juce::uint8>& row)
+    {
+        if ((int)row.size() != width)
+            return;
+
+        newestRow = (newestRow + 1) % numRows;
+        std::copy(row.begin(), row.end(), rows.begin() + (ptrdiff_t)newestRow * width);
+        numStored = juce::jmin(numStored + 1, numRows);
+    }
+
+    int getWidth() const { return width; }
+    int getNumStoredRows() const { return numStored; }
+
+    //0 is the newest
+    const juce::uint8* getRow(int age) const
+    {
+        jassert(juce::isPositiveAndBelow(age, numStored));
+        return rows.data() + (size_t)(((newestRow - age + numRows) % numRows) * width);
+    }
+
+private:
+    std::vector<juce::uint8> rows;
+    int width = 0, numRows = 1, newestRow = 0, numStored = 0;
+};
+
+//picks the editor's frame rate. full speed normally, a step down when the audio thread is busy or the message
+//thread can't keep the timer on time (both mean the machine is short of cpu), back up after things stay calm
+struct FrameRateGovernor
+{
+    static constexpr std::array<int, 3> frameRates{ 60, 30, 15 };
+
+    //call once per tick with the processor's load (0 to 1), returns the rate the timer should run at
+    int update(double audioLoad, double nowMs)
+    {
+        const auto frameRate = frameRates[(size_t)step];
+
+        //how late the timer fires, 1 is on time
+        if (lastTickMs > 0.0)
+            lateness += 0.1 * ((nowMs - lastTickMs) * frameRate / 1000.0 - lateness);
+
+        lastTickMs = nowMs;
+
+        busyTicks = (audioLoad > 0.7 || lateness > 1.5) ? busyTicks + 1 : 0;
+        calmTicks = (audioLoad < 0.5 && lateness < 1.2) ? calmTicks + 1 : 0;
+
+        //half a second of trouble to slow down, two calm seconds to speed up again
+        if (busyTicks > frameRate / 2 && step < (int)frameRates.size() - 1)
+            changeStep(step + 1);
+        else if (calmTicks > frameRate * 2 && step > 0)
+            changeStep(step - 1);
+
+        return frameRates[(size_t)step];
+    }
+
+private:
+    int step = 0;
+    double lastTickMs = 0.0, lateness = 1.0;
+    int busyTicks = 0, calmTicks = 0;
+
+    void changeStep(int newStep)
+    {
+        step = newStep;
+        busyTicks = calmTicks = 0;
+        //the next interval is measured against the new rate
+        lastTickMs = 0.0;
+        lateness = 1.0;
+    }
 };
 
 struct ResponseCurveComponent : juce::Component, //inherit from listener class so processing can be done 
@@ -252,32 +916,58 @@ struct ResponseCurveComponent : juce::Component, //inherit from listener class s
     void parameterValueChanged(int parameterIndex, float newValue) override;
 
     void parameterGestureChanged(int parameterIndex, bool gestureIsStarting) override {}
-    //our timer will check whether parameter has changed and response curve needs updating
+    //our timer will check whether the processor published new coefficients and the response curve needs updating
     void timerCallback() override;
 
     void paint(juce::Graphics& g) override;
 
     void resized() override;
 
-   
+    void setFFTOrder(FFTOrder newOrder);
+    void setFFTOverlap(FFTOverlap newOverlap);
+    void setAnalyzerView(AnalyzerView newView);
 
 private:
     CompASAudioProcessor& audioProcessor;
-    juce::Atomic<bool> parametersChanged{ false };
-    monoChain MonoChain;
 
     void updateResponseCurve();
     juce::Path responseCurve;
+    //picks up the processor's newest coefficient snapshot, the editor doesn't design any filters of its own
     void updateChain();
 
+    //the response per stage, plus what each stage was last evaluated from so unchanged ones are left alone
+    ResponseCurveCache responseCache;
+    ChainCoefficients drawnCoefficients;
+    juce::uint32 drawnVersion = 0;
+
     //pre-rendering an image
     juce::Image background;
+    //the response curve and the frame around it, only redrawn when the curve moves. paint just blits it
+    juce::Image curveLayer;
+    void renderCurveLayer();
+
+    FrameRateGovernor frameRateGovernor;
+    int frameRate = 60;
+
+    //waterfall view: newest row at the top. a new row scrolls the image down a pixel with one blit and only that
+    //row gets drawn, so neither updating nor painting it costs more with a longer history
+    bool showWaterfall = false;
+    WaterfallHistory waterfallHistory;
+    juce::Image waterfallImage;
+    std::vector<juce::uint8> waterfallRow;
+    std::array<juce::Colour, 256> waterfallColours;
+    void addWaterfallRow();
+    void drawWaterfallRow(int y, const juce::uint8* row);
+    void prepareWaterfall();
 
     juce::Rectangle<int> getRenderArea();
 
     juce::Rectangle<int> getAnalysisArea();
 
-    PathProducer leftPathProducer, rightPathProducer;
+    //left and right share one producer, and with it one FFT
+    PathProducer pathProducer;
+    //declared after the producer so it's stopped before it goes away
+    AnalyzerThread analyzerThread{ pathProducer };
 };
 
 // buffer -> fixed size blocks -> fft blocks -> path producer -> (juce::path) -> GUI
@@ -286,15 +976,24 @@ private:
 //==============================================================================
 /**
 */
-class CompASAudioProcessorEditor : public juce::AudioProcessorEditor
+class CompASAudioProcessorEditor : public juce::AudioProcessorEditor,
+    juce::ValueTree::Listener,
+    juce::AsyncUpdater
 {
 public:
     CompASAudioProcessorEditor (CompASAudioProcessor&);
+    ~CompASAudioProcessorEditor() override;
 
     //==============================================================================
     void paint (juce::Graphics&) override;
     void resized() override;
 
+    //the analyzer settings live in the plugin state, so a preset or session recall while we're open has to reach
+    //the boxes. the state can be replaced from any thread, the boxes are brought in line on the message thread
+    void valueTreePropertyChanged(juce::ValueTree& tree, const juce::Identifier& property) override;
+    void valueTreeRedirected(juce::ValueTree& tree) override;
+    void handleAsyncUpdate() override;
+
 
 private:
     // This reference is provided as a quick way for your editor to
@@ -313,6 +1012,12 @@ private:
 
     ResponseCurveComponent responseCurveComponent;
 
+    //analyzer resolution and view, display settings rather than a parameter but saved with the rest of the state
+    static constexpr int analyzerSettingsHeight = 24;
+    juce::ComboBox fftOrderBox, fftOverlapBox, analyzerViewBox;
+    //selects what the state says in each box, without notifying, and hands it to the analyzer
+    void syncAnalyzerSettings();
+
     //to connect sliders to control, we can use apvts
 
     using APVTS = juce::AudioProcessorValueTreeState;
@@ -327,6 +1032,10 @@ private:
             lowCutSlopeSliderAttachment,
             highCutSlopeSliderAttachment;
 
+    //biquad or SVF, a real parameter unlike the analyzer boxes. the attachment is made once the box has its items
+    juce::ComboBox filterEngineBox;
+    std::unique_ptr<APVTS::ComboBoxAttachment> filterEngineBoxAttachment;
+
     //all components have same thing to be done to them, so
     //we can make vector and have it iterate over 
     std::vector<juce::Component*> getComps();
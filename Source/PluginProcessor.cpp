@@ -22,6 +22,8 @@ CompASAudioProcessor::CompASAudioProcessor()
                        )
 #endif
 {
+    //designs until prepareToPlay use the default rate, the audio thread throws those away when it gets them
+    coefficientDesigner.startThread();
 }
 
 CompASAudioProcessor::~CompASAudioProcessor()
@@ -100,17 +102,31 @@ void CompASAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock
     spec.maximumBlockSize = samplesPerBlock;
     //max samples to process
 
-    spec.numChannels = 1;
-    //no of channels, mono=1
+    spec.numChannels = getTotalNumOutputChannels();
+    //the cascade handles every channel at once
 
     spec.sampleRate = sampleRate;
 
-    leftChain.prepare(spec);
-    rightChain.prepare(spec);
-
-    auto chainSettings = getChainSettings(apvts); //we can get values for all our parameters
+    filterCascade.prepare(spec);
 
+    //design once up front so the first block is right, after that the designer thread takes over
     updateFilter();
+    //start from a clean state with the new coefficients in place rather than gliding in from the old ones
+    filterCascade.reset();
+
+    svfCascade.prepare(spec);
+    updateSvfCascade(getChainSettings(parameters));
+    svfCascade.reset();
+
+    //whichever engine is selected just starts, there's nothing playing yet to fade from
+    activeEngine = static_cast<FilterEngine>(parameters.get<Param_FilterEngine>());
+    engineFadeLength = juce::jmax(1, (int)(sampleRate * engineFadeSeconds));
+    engineFadeRemaining = 0;
+    engineFadeBuffer.setSize((int)spec.numChannels, engineFadeLength, false, true, true);
+
+    coefficientDesigner.prepare(sampleRate);
+
+    loadMeasurer.reset(sampleRate, samplesPerBlock);
 
     //prepare fifo 
     leftChannelFifo.prepare(samplesPerBlock);
@@ -155,6 +171,7 @@ void CompASAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    //the coefficient designer keeps running, the editor still needs designs while nothing is playing
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -186,6 +203,7 @@ bool CompASAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) c
 void CompASAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
+    const juce::AudioProcessLoadMeasurer::ScopedTimer loadTimer(loadMeasurer, buffer.getNumSamples());
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -200,7 +218,7 @@ void CompASAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce:
 
     // for our sliders to change values, we need to pass it before processing the blocks, so our sliders actually change values
 
-    auto chainSettings = getChainSettings(apvts); //we can get values for all our parameters
+    auto chainSettings = getChainSettings(parameters); //we can get values for all our parameters
     
     //updatePeakFilter(chainSettings);
 
@@ -324,30 +342,129 @@ void CompASAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce:
    // auto& rightHighCut = rightChain.get<ChainPositions::highCut>();
    // updateCutFilter(rightHighCut, cutCoeffH, chainSettings.highCutSlope);
 
-    updateFilter();
+    //only ask for a new design when a parameter actually moved
+    if (chainSettings != requestedSettings)
+    {
+        requestedSettings = chainSettings;
+
+        //offline renders aren't time critical, designing here keeps them in step with automation
+        if (isNonRealtime())
+            updateFilter();
+        else
+            coefficientDesigner.requestUpdate();
+    }
+
+    //pick up the newest finished set, anything older is already out of date
+    ChainCoefficients chainCoefficients;
+    bool gotCoefficients = false;
+    while (coefficientDesigner.pullCoefficients(chainCoefficients))
+        gotCoefficients = true;
+
+    if (gotCoefficients)
+    {
+        if (chainCoefficients.sampleRate == getSampleRate())
+            applyCoefficients(chainCoefficients);
+
+        //the designer reads the parameters itself, so if it saw something else than we asked for, ask again
+        if (chainCoefficients.sampleRate != getSampleRate() || chainCoefficients.settings != requestedSettings)
+            coefficientDesigner.requestUpdate();
+    }
 
     juce::dsp::AudioBlock<float> block(buffer);
 
-    auto leftBlock = block.getSingleChannelBlock(0);
-    auto rightBlock = block.getSingleChannelBlock(1);
+    //all channels share the lanes of one cascade, so there's a single pass instead of one chain per side
+    juce::dsp::ProcessContextReplacing<float> context(block);
+
+    auto engine = static_cast<FilterEngine>(parameters.get<Param_FilterEngine>());
+
+    //the engine we switch to has been idle, start it from rest and fade over from the one that was running.
+    //a switch that comes in mid-fade waits for it to finish
+    if (engine != activeEngine && engineFadeRemaining == 0)
+    {
+        fadingOutEngine = activeEngine;
+        activeEngine = engine;
+        engineFadeRemaining = engineFadeLength;
+
+        if (engine == FilterEngine::Engine_SVF)
+        {
+            updateSvfCascade(chainSettings);
+            svfCascade.reset();
+        }
+        else
+        {
+            filterCascade.reset();
+        }
+    }
+
+    const auto svfRunning = activeEngine == FilterEngine::Engine_SVF
+        || (engineFadeRemaining > 0 && fadingOutEngine == FilterEngine::Engine_SVF);
+
+    if (svfRunning && chainSettings != svfSettings)
+        updateSvfCascade(chainSettings);
 
-    //after getting left and right, we get the context
+    if (engineFadeRemaining > 0)
+    {
+        //only the part of the block that's still fading needs the old engine
+        const auto fadeStart = engineFadeLength - engineFadeRemaining;
+        const auto length = juce::jmin(engineFadeRemaining, (int)block.getNumSamples());
+        const auto numChannels = juce::jmin((int)block.getNumChannels(), engineFadeBuffer.getNumChannels());
 
-    juce::dsp::ProcessContextReplacing<float> leftContext(leftBlock);
-    juce::dsp::ProcessContextReplacing<float> rightContext(rightBlock);
+        for (int ch = 0; ch < numChannels; ++ch)
+            engineFadeBuffer.copyFrom(ch, 0, buffer, ch, 0, length);
 
-    leftChain.process(leftContext);
-    rightChain.process(rightContext);
+        juce::dsp::AudioBlock<float> oldBlock(engineFadeBuffer.getArrayOfWritePointers(), (size_t)numChannels, (size_t)length);
+        processEngine(fadingOutEngine, juce::dsp::ProcessContextReplacing<float>(oldBlock));
+        processEngine(activeEngine, context);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto* data = buffer.getWritePointer(ch);
+            const auto* old = engineFadeBuffer.getReadPointer(ch);
+
+            for (int i = 0; i < length; ++i)
+            {
+                const auto gain = (float)(fadeStart + i) / (float)engineFadeLength;
+                data[i] = old[i] + gain * (data[i] - old[i]);
+            }
+        }
+
+        engineFadeRemaining -= length;
+    }
+    else
+    {
+        processEngine(activeEngine, context);
+    }
 
     // we can pass the context, now our plugin is getting audio
 
-    //update fifo 
-    leftChannelFifo.update(buffer);
-    rightChannelFifo.update(buffer);
+    //update fifo, only if an editor is around to read it
+    if (isAnalyzerAttached())
+    {
+        leftChannelFifo.update(buffer);
+        rightChannelFifo.update(buffer);
+    }
 
 }
 
 //==============================================================================
+void CompASAudioProcessor::attachAnalyzer()
+{
+    //whatever was left over from the last time an editor was open is stale, drop it before the taps come back on
+    if (numAnalyzerConsumers.load() == 0)
+    {
+        leftChannelFifo.discardAvailableSamples();
+        rightChannelFifo.discardAvailableSamples();
+    }
+
+    ++numAnalyzerConsumers;
+}
+
+void CompASAudioProcessor::detachAnalyzer()
+{
+    jassert(numAnalyzerConsumers.load() > 0);
+    --numAnalyzerConsumers;
+}
+
 bool CompASAudioProcessor::hasEditor() const
 {
     return true; // (change this to false if you choose to not supply an editor)
@@ -388,7 +505,8 @@ void CompASAudioProcessor::setStateInformation (const void* data, int sizeInByte
     auto tree = juce::ValueTree::readFromData(data, sizeInBytes);
     if (tree.isValid()) {
         apvts.replaceState(tree);
-        updateFilter();
+        //the next block sees the new values and asks the designer for them
+        coefficientDesigner.requestUpdate();
     }
 }
 
@@ -396,30 +514,55 @@ void CompASAudioProcessor::setStateInformation (const void* data, int sizeInByte
 
 //populate our DS ChainSettings
 
-ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts)
+ChainSettings getChainSettings(const CachedParameters& parameters)
 {
     ChainSettings settings;
 
     //we can get parameters either by apvts.getParameter()->getValue
     //but we get normalized values
 
-    //second way, we get raw values
-    settings.highCutFreq = apvts.getRawParameterValue("HighCut Freq")->load();
-    settings.highCutSlope = static_cast<Slope>(apvts.getRawParameterValue("HighCut Slope")->load());
-    settings.lowCutFreq = apvts.getRawParameterValue("LowCut Freq")->load();
-    settings.lowCutSlope = static_cast<Slope>(apvts.getRawParameterValue("LowCut Slope")->load());
-    settings.peakFreq = apvts.getRawParameterValue("Peak Freq")->load();
-    settings.peakGainInDecibels = apvts.getRawParameterValue("Peak Gain")->load();
-    settings.peakQuality = apvts.getRawParameterValue("Peak Quality")->load();
+    //second way, we get raw values - the atomics were looked up once when the processor was built
+    settings.highCutFreq = parameters.get<Param_HighCutFreq>();
+    settings.highCutSlope = static_cast<Slope>(parameters.get<Param_HighCutSlope>());
+    settings.lowCutFreq = parameters.get<Param_LowCutFreq>();
+    settings.lowCutSlope = static_cast<Slope>(parameters.get<Param_LowCutSlope>());
+    settings.peakFreq = parameters.get<Param_PeakFreq>();
+    settings.peakGainInDecibels = parameters.get<Param_PeakGain>();
+    settings.peakQuality = parameters.get<Param_PeakQuality>();
 
         return settings;
 }
 
-Coefficients makePeakFilter(const ChainSettings& chainSettings, double sampleRate) {
-    return juce::dsp::IIR::Coefficients<float>::makePeakFilter(sampleRate, chainSettings.peakFreq, chainSettings.peakQuality, juce::Decibels::decibelsToGain(chainSettings.peakGainInDecibels));
+bool operator==(const ChainSettings& lhs, const ChainSettings& rhs)
+{
+    return lhs.peakFreq == rhs.peakFreq
+        && lhs.peakGainInDecibels == rhs.peakGainInDecibels
+        && lhs.peakQuality == rhs.peakQuality
+        && lhs.lowCutFreq == rhs.lowCutFreq
+        && lhs.highCutFreq == rhs.highCutFreq
+        && lhs.lowCutSlope == rhs.lowCutSlope
+        && lhs.highCutSlope == rhs.highCutSlope;
 }
 
-void CompASAudioProcessor::updatePeakFilter(const ChainSettings& chainSettings) {
+void makePeakFilter(BiquadCoefficients& peak, const ChainSettings& chainSettings, double sampleRate) {
+    //same maths as juce::dsp::IIR::Coefficients::makePeakFilter, just written into our own storage
+    const auto normalisedFreq = juce::jlimit(1.0e-5, 0.499, chainSettings.peakFreq / sampleRate);
+    const auto A = std::sqrt((double)juce::Decibels::decibelsToGain(chainSettings.peakGainInDecibels));
+    const auto omega = juce::MathConstants<double>::twoPi * normalisedFreq;
+    const auto alpha = std::sin(omega) / (chainSettings.peakQuality * 2.0);
+    const auto c2 = -2.0 * std::cos(omega);
+    const auto alphaTimesA = alpha * A;
+    const auto alphaOverA = alpha / A;
+    const auto a0 = 1.0 / (1.0 + alphaOverA);
+
+    peak[0] = (float)((1.0 + alphaTimesA) * a0);
+    peak[1] = (float)(c2 * a0);
+    peak[2] = (float)((1.0 - alphaTimesA) * a0);
+    peak[3] = (float)(c2 * a0);
+    peak[4] = (float)((1.0 - alphaOverA) * a0);
+}
+
+void CompASAudioProcessor::updatePeakFilter(const ChainCoefficients& chainCoefficients, StageFlags& stageActive) {
 /*    auto peakCoeff = juce::dsp::IIR::Coefficients<float>::makePeakFilter(
         getSampleRate(),
         chainSettings.peakFreq,
@@ -431,10 +574,9 @@ void CompASAudioProcessor::updatePeakFilter(const ChainSettings& chainSettings)
     // commenting cause refactored so function handles replacement
    // *leftChain.get<ChainPositions::peak>().coefficients = *peakCoeff;
     // *rightChain.get<ChainPositions::peak>().coefficients = *peakCoeff;
-    auto peakCoeff = makePeakFilter(chainSettings, getSampleRate());
 
-    updateCoefficients(leftChain.get<ChainPositions::peak>().coefficients, peakCoeff);
-    updateCoefficients(rightChain.get<ChainPositions::peak>().coefficients, peakCoeff);
+    filterCascade.setStage(CascadeStages::peakStage, chainCoefficients.peak);
+    stageActive[CascadeStages::peakStage] = chainCoefficients.peakActive;
 
 }
 
@@ -442,66 +584,94 @@ void updateCoefficients(Coefficients& old, const Coefficients& replacements) {
     *old = *replacements;
 }
 
-void CompASAudioProcessor::updateLowCutFilter(const ChainSettings& chainSettings) {
-    auto cutCoeff = makeLowCutFilter(chainSettings, getSampleRate());
+ChainCoefficients makeChainCoefficients(const ChainSettings& chainSettings, double sampleRate)
+{
+    ChainCoefficients chainCoefficients;
+    chainCoefficients.settings = chainSettings;
+    chainCoefficients.sampleRate = sampleRate;
 
-    auto& leftLowCut = leftChain.get<ChainPositions::lowCut>();
-    updateCutFilter(leftLowCut, cutCoeff, chainSettings.lowCutSlope);
-    auto& rightLowCut = rightChain.get<ChainPositions::lowCut>();
-    updateCutFilter(rightLowCut, cutCoeff, chainSettings.lowCutSlope);
+    makePeakFilter(chainCoefficients.peak, chainSettings, sampleRate);
+
+    //stages that wouldn't change the sound get dropped from the processing path
+    //a 0dB peak is exactly b == a, and cuts parked at the edges of their range count as switched off
+    chainCoefficients.peakActive = std::abs(chainSettings.peakGainInDecibels) > 0.01f;
+    chainCoefficients.lowCutActive = chainSettings.lowCutFreq > lowCutOffFreq;
+    chainCoefficients.highCutActive = chainSettings.highCutFreq < highCutOffFreq;
+
+    //only the first (slope + 1) sections get designed, the rest stay bypassed
+    makeLowCutFilter(chainCoefficients.lowCut, chainSettings, sampleRate);
+    makeHighCutFilter(chainCoefficients.highCut, chainSettings, sampleRate);
+
+    return chainCoefficients;
 }
 
-void CompASAudioProcessor::updateHighCutFilter(const ChainSettings& chainSettings) {
-    auto cutCoeffH = makeHighCutFilter(chainSettings, getSampleRate());
+//same switch fall-through idea as updateCutFilter, the first (slope + 1) sections run and the rest are bypassed
+void CompASAudioProcessor::updateLowCutFilter(const ChainCoefficients& chainCoefficients, StageFlags& stageActive) {
+    const auto& cutCoeff = chainCoefficients.lowCut;
+    const auto lowCutSlope = chainCoefficients.settings.lowCutSlope;
 
-    auto& leftHighCut = leftChain.get<ChainPositions::highCut>();
-    updateCutFilter(leftHighCut, cutCoeffH, chainSettings.highCutSlope);
-    auto& rightHighCut = rightChain.get<ChainPositions::highCut>();
-    updateCutFilter(rightHighCut, cutCoeffH, chainSettings.highCutSlope);
+    for (int i = 0; i < 4; ++i)
+    {
+        filterCascade.setStage(CascadeStages::lowCutStage + i, cutCoeff[i]);
+        stageActive[CascadeStages::lowCutStage + i] = chainCoefficients.lowCutActive && i <= lowCutSlope;
+    }
+}
+
+void CompASAudioProcessor::updateHighCutFilter(const ChainCoefficients& chainCoefficients, StageFlags& stageActive) {
+    const auto& cutCoeffH = chainCoefficients.highCut;
+    const auto highCutSlope = chainCoefficients.settings.highCutSlope;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        filterCascade.setStage(CascadeStages::highCutStage + i, cutCoeffH[i]);
+        stageActive[CascadeStages::highCutStage + i] = chainCoefficients.highCutActive && i <= highCutSlope;
+    }
+}
+
+void CompASAudioProcessor::applyCoefficients(const ChainCoefficients& chainCoefficients) {
+    //plain copies into the existing coefficient objects, safe for the audio thread
+    StageFlags stageActive{};
+    updatePeakFilter(chainCoefficients, stageActive);
+    updateHighCutFilter(chainCoefficients, stageActive);
+    updateLowCutFilter(chainCoefficients, stageActive);
+
+    //handed over in one go, so a change in which stages run gets a single crossfade
+    filterCascade.setActiveStages(stageActive);
 }
 
 void CompASAudioProcessor::updateFilter() {
-    auto chainSettings = getChainSettings(apvts);
+    auto chainSettings = getChainSettings(parameters);
+    requestedSettings = chainSettings;
 
-    updatePeakFilter(chainSettings);
-    updateHighCutFilter(chainSettings);
-    updateLowCutFilter(chainSettings);
+    const auto chainCoefficients = makeChainCoefficients(chainSettings, getSampleRate());
+    coefficientSnapshots.publish(chainCoefficients);
+    applyCoefficients(chainCoefficients);
 }
 
-juce::AudioProcessorValueTreeState::ParameterLayout
-CompASAudioProcessor::createParameterLayout() 
+//the svf sections are cheap to re-derive, so they take the parameters directly and smooth them per sample
+void CompASAudioProcessor::processEngine(FilterEngine engine, const juce::dsp::ProcessContextReplacing<float>& context)
 {
-    
-    // using AudioParameterFloat means we're using a range of values
-    juce::AudioProcessorValueTreeState::ParameterLayout layout; //make an object of class parameter layout
-    layout.add(std::make_unique<juce::AudioParameterFloat>("LowCut Freq", "LowCut Freq", juce::NormalisableRange<float>(20.f, 20000.f, 1.f, 0.25f), 20.f));
-       //layout.add adds the parameter, we pass the name, ID, the min value and the default value, default for low pass=20Hz and highpass=20k Hz
-    layout.add(std::make_unique<juce::AudioParameterFloat>("HighCut Freq", "HighCut Freq", juce::NormalisableRange<float>(20.f, 20000.f, 1.f, 0.25f), 20000.f));
-
-    //peak freq
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Peak Freq", "Peak Freq", juce::NormalisableRange<float>(20.f, 20000.f, 1.f, 0.25f), 750.f));
-
-    //peak gain(defined in decibles 
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Peak Gain", "Peak Gain", juce::NormalisableRange<float>(-24.f, 24.f, 0.5f, 1.f), 0.0f));
-
-    //quality control (low Q - wide) (high Q- narrow)
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Peak Quality", "Peak Quality", juce::NormalisableRange<float>(0.1f, 10.0f, 0.5f, 1.0f), 1.0f));
-
-    //make a string array for parameters that accept in dB/Octave
-    //bands like these use multiples of 12 or 6 so we fill it with multiples of 12
-    juce::StringArray stringArray;
-    for (int i = 0; i < 4; i++) {
-        juce::String str;
-        str << (12 + i * 12);
-        str << " dB/Oct";
-        stringArray.add(str);
-    }
+    if (engine == FilterEngine::Engine_SVF)
+        svfCascade.process(context);
+    else
+        filterCascade.process(context);
+}
 
-    //now we add to layout
-    layout.add(std::make_unique<juce::AudioParameterChoice>("LowCut Slope", "LowCut Slope", stringArray, 0));
-    layout.add(std::make_unique<juce::AudioParameterChoice>("HighCut Slope", "HighCut Slope", stringArray, 0));
+void CompASAudioProcessor::updateSvfCascade(const ChainSettings& chainSettings) {
+    svfSettings = chainSettings;
+    svfCascade.setLowCut(chainSettings.lowCutFreq, butterworthInverseQ[chainSettings.lowCutSlope],
+        chainSettings.lowCutSlope + 1, chainSettings.lowCutFreq > lowCutOffFreq);
+    svfCascade.setPeak(chainSettings.peakFreq, chainSettings.peakGainInDecibels, chainSettings.peakQuality,
+        std::abs(chainSettings.peakGainInDecibels) > 0.01f);
+    svfCascade.setHighCut(chainSettings.highCutFreq, butterworthInverseQ[chainSettings.highCutSlope],
+        chainSettings.highCutSlope + 1, chainSettings.highCutFreq < highCutOffFreq);
+}
 
-    return layout;
+juce::AudioProcessorValueTreeState::ParameterLayout
+CompASAudioProcessor::createParameterLayout() 
+{
+    //ranges, defaults and choices all live in the parameterInfos table (Parameters.h)
+    return createParameterLayoutFromTable();
 }
 
 //==============================================================================
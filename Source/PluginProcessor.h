@@ -9,18 +9,52 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "BiquadCascade.h"
+#include "SvfCascade.h"
+#include "Parameters.h"
 
 //class below retrieves the blocks of buffer from the below fifo
 
 #include <array>
+#include <utility>
+#include <vector>
+
+//single producer / single consumer queue of preallocated slots. nothing is copied on the way through:
+//either fill a slot in place (beginWrite/finishWrite, beginRead/finishRead) or swap your object with
+//the slot (push/pull), which hands the other side's old storage back for reuse instead of allocating
 template<typename T>
 struct Fifo
 {
+    static constexpr int defaultCapacity = 30;
+
+    explicit Fifo(int capacity = defaultCapacity)
+    {
+        setCapacity(capacity);
+    }
+
+    //allocates, so only call it while neither side is using the fifo
+    void setCapacity(int newCapacity)
+    {
+        jassert(newCapacity > 1);
+        slots.resize((size_t)newCapacity);
+        fifo.setTotalSize(newCapacity);
+        fifo.reset();
+        resetStatistics();
+    }
+
+    int getCapacity() const { return fifo.getTotalSize(); }
+
+    //drops everything unread, same rule as setCapacity
+    void reset()
+    {
+        fifo.reset();
+    }
+
     void prepare(int numChannels, int numSamples)
     {
         static_assert(std::is_same_v<T, juce::AudioBuffer<float>>,
             "prepare(numChannels, numSamples) should only be used when the Fifo is holding juce::AudioBuffer<float>");
-        for (auto& buffer : buffers)
+        for (auto& buffer : slots)
         {
             buffer.setSize(numChannels,
                 numSamples,
@@ -35,19 +69,56 @@ struct Fifo
     {
         static_assert(std::is_same_v<T, std::vector<float>>,
             "prepare(numElements) should only be used when the Fifo is holding std::vector<float>");
-        for (auto& buffer : buffers)
+        for (auto& buffer : slots)
         {
             buffer.clear();
             buffer.resize(numElements, 0);
         }
     }
+    //==============================================================================
+    //the next free slot, or nullptr (counted as a dropped frame) if the reader hasn't kept up
+    T* beginWrite()
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+        if (size1 > 0)
+            return &slots[(size_t)start1];
+
+        ++droppedFrames;
+        return nullptr;
+    }
+
+    //publishes the slot returned by beginWrite
+    void finishWrite()
+    {
+        fifo.finishedWrite(1);
+        ++writtenFrames;
+    }
+
+    //the oldest unread slot, or nullptr if there's nothing to read
+    T* beginRead()
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(1, start1, size1, start2, size2);
+
+        return size1 > 0 ? &slots[(size_t)start1] : nullptr;
+    }
 
-    bool push(const T& t)
+    //hands the slot returned by beginRead back to the writer
+    void finishRead()
     {
-        auto write = fifo.write(1);
-        if (write.blockSize1 > 0)
+        fifo.finishedRead(1);
+    }
+    //==============================================================================
+    //t and the slot trade places, t comes back holding whatever the slot had before
+    bool push(T& t)
+    {
+        if (auto* slot = beginWrite())
         {
-            buffers[write.startIndex1] = t;
+            using std::swap;
+            swap(*slot, t);
+            finishWrite();
             return true;
         }
 
@@ -56,10 +127,11 @@ struct Fifo
 
     bool pull(T& t)
     {
-        auto read = fifo.read(1);
-        if (read.blockSize1 > 0)
+        if (auto* slot = beginRead())
         {
-            t = buffers[read.startIndex1];
+            using std::swap;
+            swap(*slot, t);
+            finishRead();
             return true;
         }
 
@@ -70,10 +142,68 @@ struct Fifo
     {
         return fifo.getNumReady();
     }
+
+    int getFreeSpace() const
+    {
+        return fifo.getFreeSpace();
+    }
+    //==============================================================================
+    int getNumWrittenFrames() const { return writtenFrames.get(); }
+    int getNumDroppedFrames() const { return droppedFrames.get(); }
+
+    void resetStatistics()
+    {
+        writtenFrames.set(0);
+        droppedFrames.set(0);
+    }
 private:
-    static constexpr int Capacity = 30;
-    std::array<T, Capacity> buffers;
-    juce::AbstractFifo fifo{ Capacity };
+    std::vector<T> slots;
+    juce::AbstractFifo fifo{ defaultCapacity };
+    juce::Atomic<int> writtenFrames = 0, droppedFrames = 0;
+};
+
+//hands the newest copy of a value to one reader, who never waits for the writers.
+//three slots: the reader holds one, a writer fills another and the third holds the newest finished copy,
+//each side swaps its own slot with that one. so a snapshot isn't written to again until the reader has let go of it
+template<typename T>
+struct SnapshotExchange
+{
+    struct Snapshot
+    {
+        T value{};
+        //goes up by one with every publish, 0 until the first
+        juce::uint32 version = 0;
+    };
+
+    //writers only ever wait for each other, never for the reader
+    void publish(const T& value)
+    {
+        const juce::SpinLock::ScopedLockType lock(writerLock);
+
+        auto& slot = slots[(size_t)writeSlot];
+        slot.value = value;
+        slot.version = ++publishedVersion;
+
+        writeSlot = latest.exchange(writeSlot | freshFlag, std::memory_order_acq_rel) & slotMask;
+    }
+
+    //reader side: moves on to the newest snapshot if there is one, the reference stays good until the next call
+    const Snapshot& getLatest()
+    {
+        if ((latest.load(std::memory_order_relaxed) & freshFlag) != 0)
+            readSlot = latest.exchange(readSlot, std::memory_order_acq_rel) & slotMask;
+
+        return slots[(size_t)readSlot];
+    }
+
+private:
+    static constexpr int slotMask = 3, freshFlag = 4;
+
+    std::array<Snapshot, 3> slots;
+    std::atomic<int> latest{ 1 };
+    int writeSlot = 0, readSlot = 2;
+    juce::uint32 publishedVersion = 0;
+    juce::SpinLock writerLock;
 };
 
 //two FFTs, one for each channel
@@ -84,6 +214,8 @@ enum Channel {
 
 
 //Since FFTs work in particular buffer sizes, this class does that work for us
+//the audio thread copies whole blocks into a preallocated single-producer/single-consumer ring,
+//a wrap-around is at most two vector copies. the gui side then reads whatever amount it needs
 
 template<typename BlockType>
 struct SingleChannelSampleFifo
@@ -96,57 +228,95 @@ struct SingleChannelSampleFifo
     void update(const BlockType& buffer)
     {
         jassert(prepared.get());
-        jassert(buffer.getNumChannels() > channelToUse);
-        auto* channelPtr = buffer.getReadPointer(channelToUse);
 
-        for (int i = 0; i < buffer.getNumSamples(); ++i)
+        if (buffer.getNumChannels() == 0)
+            return;
+
+        //a mono layout only has the one channel, both taps read it
+        auto channel = buffer.getNumChannels() > channelToUse ? (int)channelToUse : 0;
+        auto* channelPtr = buffer.getReadPointer(channel);
+        auto numSamples = buffer.getNumSamples();
+
+        int start1, size1, start2, size2;
+        ringFifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+        if (size1 > 0)
+            juce::FloatVectorOperations::copy(ring.getWritePointer(0, start1), channelPtr, size1);
+        if (size2 > 0)
+            juce::FloatVectorOperations::copy(ring.getWritePointer(0, start2), channelPtr + size1, size2);
+
+        ringFifo.finishedWrite(size1 + size2);
+
+        //the reader fell behind, whatever didn't fit is dropped and counted
+        if (size1 + size2 < numSamples)
         {
-            pushNextSampleIntoFifo(channelPtr[i]);
+            droppedSamples += numSamples - (size1 + size2);
+            ++overflows;
         }
     }
 
     void prepare(int bufferSize)
     {
         prepared.set(false);
-        size.set(bufferSize);
 
-        bufferToFill.setSize(1,             //channel
-            bufferSize,    //num samples
+        //room for plenty of gui frames and tiny host buffers, and for the analyzer's biggest window at the
+        //session rate: 8192 points at 48k are 65536 samples by the time a 384k session has been brought down to it
+        auto capacity = juce::nextPowerOfTwo(juce::jmax(bufferSize * 8, minimumCapacity));
+
+        ring.setSize(1,             //channel
+            capacity,      //num samples
             false,         //keepExistingContent
             true,          //clear extra space
             true);         //avoid reallocating
-        audioBufferFifo.prepare(1, bufferSize);
-        fifoIndex = 0;
+        ringFifo.setTotalSize(capacity);
+        ringFifo.reset();
+
+        droppedSamples.set(0);
+        overflows.set(0);
         prepared.set(true);
     }
     //==============================================================================
-    int getNumCompleteBuffersAvailable() const { return audioBufferFifo.getNumAvailableForReading(); }
+    int getNumSamplesAvailable() const { return ringFifo.getNumReady(); }
     bool isPrepared() const { return prepared.get(); }
-    int getSize() const { return size.get(); }
+    //how much the reader has missed since prepare()
+    int getNumDroppedSamples() const { return droppedSamples.get(); }
+    int getNumOverflows() const { return overflows.get(); }
+    //reader side, skips the oldest numSamples without reading them
+    void discardSamples(int numSamples) { ringFifo.finishedRead(juce::jmin(numSamples, ringFifo.getNumReady())); }
+    //throws away everything that's waiting so the next read starts from fresh audio
+    void discardAvailableSamples() { discardSamples(ringFifo.getNumReady()); }
     //==============================================================================
-    bool getAudioBuffer(BlockType& buf) { return audioBufferFifo.pull(buf); }
-private:
-    Channel channelToUse;
-    int fifoIndex = 0;
-    Fifo<BlockType> audioBufferFifo;
-    BlockType bufferToFill;
-    juce::Atomic<bool> prepared = false;
-    juce::Atomic<int> size = 0;
-
-    void pushNextSampleIntoFifo(float sample)
+    //reads exactly numSamples, or nothing if there aren't that many yet
+    bool pullSamples(float* dest, int numSamples)
     {
-        if (fifoIndex == bufferToFill.getNumSamples())
-        {
-            auto ok = audioBufferFifo.push(bufferToFill);
+        if (ringFifo.getNumReady() < numSamples)
+            return false;
 
-            juce::ignoreUnused(ok);
+        int start1, size1, start2, size2;
+        ringFifo.prepareToRead(numSamples, start1, size1, start2, size2);
 
-            fifoIndex = 0;
-        }
+        if (size1 > 0)
+            juce::FloatVectorOperations::copy(dest, ring.getReadPointer(0, start1), size1);
+        if (size2 > 0)
+            juce::FloatVectorOperations::copy(dest + size1, ring.getReadPointer(0, start2), size2);
 
-        bufferToFill.setSample(0, fifoIndex, sample);
-        ++fifoIndex;
+        ringFifo.finishedRead(size1 + size2);
+        return true;
     }
+private:
+    static constexpr int minimumCapacity = 1 << 17;
+
+    Channel channelToUse;
+    BlockType ring;
+    juce::AbstractFifo ringFifo{ minimumCapacity };
+    juce::Atomic<bool> prepared = false;
+    juce::Atomic<int> droppedSamples = 0, overflows = 0;
+};
+
+//which filter structure runs the chain
+enum FilterEngine {
+    Engine_Biquad,
+    Engine_SVF
 };
 
 enum Slope {
@@ -164,7 +334,11 @@ struct ChainSettings
     Slope lowCutSlope{ Slope::Slope_12 }, highCutSlope{ Slope::Slope_12 };
 };
 
-ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts); //getter
+ChainSettings getChainSettings(const CachedParameters& parameters); //getter, a handful of atomic loads
+
+//lets us tell whether anything actually moved since the last design
+bool operator==(const ChainSettings& lhs, const ChainSettings& rhs);
+inline bool operator!=(const ChainSettings& lhs, const ChainSettings& rhs) { return !(lhs == rhs); }
 
 //make monochain public for response curve
 
@@ -190,12 +364,42 @@ enum ChainPositions
 
 };
 
+//where each band lands once the chain is flattened into the processor's cascade
+enum CascadeStages
+{
+    lowCutStage = 0,    //4 stages
+    peakStage = 4,
+    highCutStage = 5,   //4 stages
+    numCascadeStages = 9
+};
+
 using Coefficients = Filter::CoefficientsPtr; //making alias for JUCE reference
 
+//plain-value copy of every coefficient in the chain, so designed sets can be handed between threads
+//without any reference counting or heap traffic
+struct ChainCoefficients
+{
+    BiquadCoefficients peak{};
+    std::array<BiquadCoefficients, 4> lowCut{}, highCut{};
+
+    //stages that are effectively identity get left out of the processing path
+    bool peakActive{ true }, lowCutActive{ true }, highCutActive{ true };
+
+    //what this set was designed from, so the audio thread can tell if it is stale
+    ChainSettings settings;
+    double sampleRate{ 0 };
+};
+
 //no member variables
 void updateCoefficients(Coefficients& old, const Coefficients& replacements);
 
-Coefficients makePeakFilter(const ChainSettings& chainSettings, double sampleRate);
+//the cut ranges end at the edges of the audible band, parked there they count as off
+constexpr float lowCutOffFreq = 20.f, highCutOffFreq = 20000.f;
+
+void makePeakFilter(BiquadCoefficients& peak, const ChainSettings& chainSettings, double sampleRate);
+
+//designs the whole chain in one go, closed form and allocation free
+ChainCoefficients makeChainCoefficients(const ChainSettings& chainSettings, double sampleRate);
 
 template<int Index, typename ChainType, typename CoefficientType>
 void update(ChainType& chain, const CoefficientType& cutCoeff) {
@@ -288,15 +492,119 @@ void updateCutFilter(ChainType& leftLowCut,
     }
 }
 
+//butterworth pole table, one row per slope and one 1/Q per 12dB section: 1/Q = 2cos((2k + 1) * pi / 2N), N = 2, 4, 6, 8
+//worked out ahead of time, so designing a whole cut filter only costs one tan() and a few multiplies per section
+constexpr std::array<std::array<double, 4>, 4> butterworthInverseQ{ {
+    { { 1.4142135623730951 } },
+    { { 1.8477590650225735, 0.7653668647301797 } },
+    { { 1.9318516525781366, 1.4142135623730951, 0.5176380902050415 } },
+    { { 1.9615705608064609, 1.6629392246050905, 1.1111404660392046, 0.39018064403225666 } }
+} };
+
+//writes the (slope + 1) sections straight into the caller's storage, no heap involved
+//same bilinear transform juce's makeHighPass/makeLowPass use, so the response matches the old designIIR... calls
+template<Slope slope, bool isHighPass>
+void designCutSections(std::array<BiquadCoefficients, 4>& sections, float frequency, double sampleRate)
+{
+    constexpr int numSections = slope + 1;
+    const auto& inverseQ = butterworthInverseQ[slope];
+
+    //keep the prewarp below nyquist, tan() blows up past it at low sample rates
+    const auto normalisedFreq = juce::jlimit(1.0e-5, 0.499, frequency / sampleRate);
+    const auto tanOmega = std::tan(juce::MathConstants<double>::pi * normalisedFreq);
+    const auto n = isHighPass ? tanOmega : 1.0 / tanOmega;
+    const auto nSquared = n * n;
+
+    for (int i = 0; i < numSections; ++i)
+    {
+        const auto c1 = 1.0 / (1.0 + inverseQ[i] * n + nSquared);
+        auto& section = sections[i];
+
+        section[0] = (float)c1;
+        section[1] = (float)(isHighPass ? -2.0 * c1 : 2.0 * c1);
+        section[2] = (float)c1;
+        section[3] = (float)(isHighPass ? c1 * 2.0 * (nSquared - 1.0) : c1 * 2.0 * (1.0 - nSquared));
+        section[4] = (float)(c1 * (1.0 - inverseQ[i] * n + nSquared));
+    }
+}
+
+//picks the right specialisation for the runtime slope
+template<bool isHighPass>
+void designCutFilter(std::array<BiquadCoefficients, 4>& sections, float frequency, Slope slope, double sampleRate)
+{
+    switch (slope)
+    {
+    case Slope_12: designCutSections<Slope_12, isHighPass>(sections, frequency, sampleRate); break;
+    case Slope_24: designCutSections<Slope_24, isHighPass>(sections, frequency, sampleRate); break;
+    case Slope_36: designCutSections<Slope_36, isHighPass>(sections, frequency, sampleRate); break;
+    case Slope_48: designCutSections<Slope_48, isHighPass>(sections, frequency, sampleRate); break;
+    }
+}
+
 //use inline so linker knows where implementation is done
-inline auto makeLowCutFilter(const ChainSettings& chainSettings, double sampleRate) {
-    return juce::dsp::FilterDesign<float>::designIIRHighpassHighOrderButterworthMethod(chainSettings.lowCutFreq, sampleRate, 2 * (chainSettings.lowCutSlope + 1));
+inline void makeLowCutFilter(std::array<BiquadCoefficients, 4>& sections, const ChainSettings& chainSettings, double sampleRate) {
+    designCutFilter<true>(sections, chainSettings.lowCutFreq, chainSettings.lowCutSlope, sampleRate);
 }
 
-inline auto makeHighCutFilter(const ChainSettings& chainSettings, double sampleRate) {
-    return juce::dsp::FilterDesign<float>::designIIRLowpassHighOrderButterworthMethod(chainSettings.highCutFreq, sampleRate, 2 * (chainSettings.highCutSlope + 1));
+inline void makeHighCutFilter(std::array<BiquadCoefficients, 4>& sections, const ChainSettings& chainSettings, double sampleRate) {
+    designCutFilter<false>(sections, chainSettings.highCutFreq, chainSettings.highCutSlope, sampleRate);
 }
 
+//designs coefficient sets on its own thread whenever the audio thread (or the editor) asks for one
+//finished sets go through a fifo, so the audio thread just pulls plain values and never waits.
+//each one is published as a snapshot as well, that's what the editor draws, so nothing gets designed twice.
+//it runs for as long as the processor exists, released or not, so the editor's curve keeps following the knobs
+struct CoefficientDesigner : juce::Thread
+{
+    CoefficientDesigner(const CachedParameters& params, SnapshotExchange<ChainCoefficients>& snapshots) :
+        juce::Thread("compAS coefficient designer"),
+        parameters(params),
+        coefficientSnapshots(snapshots)
+    {
+    }
+
+    ~CoefficientDesigner() override
+    {
+        stopThread(1000);
+    }
+
+    void prepare(double newSampleRate) { sampleRate.store(newSampleRate); }
+
+    //any thread can ask, the audio thread included: it's just a flag, the worker looks at it every few ms.
+    //notify() would take the event's lock, which the audio thread mustn't risk waiting on
+    void requestUpdate() { updateRequested.store(true, std::memory_order_release); }
+
+    bool pullCoefficients(ChainCoefficients& coefficients) { return coefficientFifo.pull(coefficients); }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            if (!updateRequested.exchange(false, std::memory_order_acq_rel))
+            {
+                wait(pollIntervalMs);
+                continue;
+            }
+
+            //always read the latest values, requests that piled up while we were busy collapse into one design
+            auto coefficients = makeChainCoefficients(getChainSettings(parameters), sampleRate.load());
+            coefficientSnapshots.publish(coefficients);
+            auto ok = coefficientFifo.push(coefficients);
+
+            juce::ignoreUnused(ok);
+        }
+    }
+
+private:
+    static constexpr int pollIntervalMs = 5;
+
+    const CachedParameters& parameters;
+    SnapshotExchange<ChainCoefficients>& coefficientSnapshots;
+    std::atomic<bool> updateRequested{ false };
+    std::atomic<double> sampleRate{ 44100.0 };
+    Fifo<ChainCoefficients> coefficientFifo;
+};
+
 //==============================================================================
 /**
 */
@@ -347,6 +655,9 @@ public:
     juce::AudioProcessorValueTreeState apvts{*this, nullptr, "Parameters", createParameterLayout()}; //apvts basically controls all the audio parameters of the project
     //we pass this as the plugin, parameters are passed by the createParameterLayout function
 
+    //every parameter's atomic looked up once, so the audio thread never searches by string
+    CachedParameters parameters{ apvts };
+
 
     //we make public instances of fifo cause gui needs access too
 
@@ -354,25 +665,72 @@ public:
     SingleChannelSampleFifo<BlockType> leftChannelFifo{ Channel::Left };
     SingleChannelSampleFifo<BlockType> rightChannelFifo{ Channel::Right };
 
+    //the editor's analyzer attaches while it's open, with nobody attached the audio thread skips the taps
+    void attachAnalyzer();
+    void detachAnalyzer();
+    bool isAnalyzerAttached() const { return numAnalyzerConsumers.load(std::memory_order_relaxed) > 0; }
+
+    //the newest coefficients the processor designed, for drawing. one reader only, the editor on the message thread
+    const SnapshotExchange<ChainCoefficients>::Snapshot& getCoefficientSnapshot() { return coefficientSnapshots.getLatest(); }
+    //asks for a design straight away, for when a parameter moves while the host isn't calling processBlock
+    void requestCoefficientUpdate() { coefficientDesigner.requestUpdate(); }
+
+    //share of the block's time processBlock takes, smoothed. safe to read from any thread
+    double getProcessLoad() const { return loadMeasurer.getLoadAsProportion(); }
+
     
 
 private:
 
-    monoChain leftChain, rightChain;
+    //lowCut (4 stages) -> peak -> highCut (4 stages), same order as monoChain
+    //every channel goes through in one pass with a single shared set of coefficients
+    SIMDBiquadCascade<CascadeStages::numCascadeStages> filterCascade;
+
+    //alternative engine for audio-rate modulation, runs straight off the parameters with per-sample smoothing
+    SvfCascade svfCascade;
+    FilterEngine activeEngine{ FilterEngine::Engine_Biquad };
+    //what the svf was last given, it smooths towards that on its own so it only needs telling when something moved
+    ChainSettings svfSettings;
+    void updateSvfCascade(const ChainSettings& chainSettings);
+
+    //switching engines: the one we left keeps running on a copy of the input for a few ms while we crossfade over,
+    //the same way the biquad cascade fades between sets of stages
+    static constexpr double engineFadeSeconds = 0.005;
+    FilterEngine fadingOutEngine{ FilterEngine::Engine_Biquad };
+    juce::AudioBuffer<float> engineFadeBuffer;
+    int engineFadeLength = 0, engineFadeRemaining = 0;
+    void processEngine(FilterEngine engine, const juce::dsp::ProcessContextReplacing<float>& context);
     //refactoring our code for filter
 
     //static void updateCoefficients(Coefficients& old, const Coefficients& replacements);
 
 
-    void updatePeakFilter(const ChainSettings& chainSettings);
+    //which cascade stages should run, filled in by the update functions below
+    using StageFlags = std::array<bool, CascadeStages::numCascadeStages>;
+
+    void updatePeakFilter(const ChainCoefficients& chainCoefficients, StageFlags& stageActive);
 
     //let's refactor so we don't reuse code
 
-    void updateLowCutFilter(const ChainSettings& chainSettings);
-    void updateHighCutFilter(const ChainSettings& chainSettings);
+    void updateLowCutFilter(const ChainCoefficients& chainCoefficients, StageFlags& stageActive);
+    void updateHighCutFilter(const ChainCoefficients& chainCoefficients, StageFlags& stageActive);
+
+    void applyCoefficients(const ChainCoefficients& chainCoefficients);
 
+    //designs and applies right away, only for places where allocating is fine (prepareToPlay, offline renders)
     void updateFilter();
 
+    //settings the last design was asked for, compared every block so we only redesign when something moved
+    ChainSettings requestedSettings;
+    //every design ends up here, declared before the designer so it outlives the thread
+    SnapshotExchange<ChainCoefficients> coefficientSnapshots;
+    CoefficientDesigner coefficientDesigner{ parameters, coefficientSnapshots };
+
+    std::atomic<int> numAnalyzerConsumers{ 0 };
+
+    //lets the editor back off its frame rate while the audio thread is busy
+    juce::AudioProcessLoadMeasurer loadMeasurer;
+
     
 
     //let's make another template to reduce code in switch below
@@ -0,0 +1,387 @@
+/*
+  ==============================================================================
+
+    Topology-preserving state-variable filter version of the EQ chain.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+//trapezoidal (TPT) state-variable filter section, as described by Zavalishin and Simper
+//the only thing that depends on the cutoff is g = tan(pi * fc / fs), everything else is a couple of
+//multiplies and one divide, so it's fine to recompute every sample while a parameter is moving.
+//the state is the two integrators, which stay meaningful when the coefficients change under them
+struct SvfCoefficients
+{
+    float a1{ 1 }, a2{ 0 }, a3{ 0 };
+    //output mix of input, band and low outputs
+    float m0{ 1 }, m1{ 0 }, m2{ 0 };
+};
+
+struct SvfState
+{
+    float ic1eq{ 0 }, ic2eq{ 0 };
+};
+
+inline SvfCoefficients makeSvf(float g, float k, float m0, float m1, float m2)
+{
+    SvfCoefficients c;
+    c.a1 = 1.f / (1.f + g * (g + k));
+    c.a2 = g * c.a1;
+    c.a3 = g * c.a2;
+    c.m0 = m0;
+    c.m1 = m1;
+    c.m2 = m2;
+    return c;
+}
+
+inline float processSvf(const SvfCoefficients& c, SvfState& s, float x)
+{
+    const auto v3 = x - s.ic2eq;
+    const auto v1 = c.a1 * s.ic1eq + c.a2 * v3;
+    const auto v2 = s.ic2eq + c.a2 * s.ic1eq + c.a3 * v3;
+    s.ic1eq = 2.f * v1 - s.ic1eq;
+    s.ic2eq = 2.f * v2 - s.ic2eq;
+
+    return c.m0 * x + c.m1 * v1 + c.m2 * v2;
+}
+
+//lowCut (up to 4 highpass sections) -> peak (bell) -> highCut (up to 4 lowpass sections)
+//frequency, gain and Q are smoothed per sample and the sections are re-derived from them every sample while
+//anything is still moving, so sweeps and modulation are as smooth as the smoothing, without redesigning biquads.
+//the magnitude response matches the bilinear biquads exactly, both are the same analog prototypes prewarped at fc
+struct SvfCascade
+{
+    static constexpr int maxCutSections = 4;
+
+    void prepare(const juce::dsp::ProcessSpec& spec)
+    {
+        sampleRate = spec.sampleRate;
+        numChannels = (int)spec.numChannels;
+
+        states.assign((size_t)numChannels, {});
+
+        //frequencies glide in log space, gain in dB and Q linearly
+        lowCutFreq.reset(sampleRate, smoothingSeconds);
+        highCutFreq.reset(sampleRate, smoothingSeconds);
+        peakFreq.reset(sampleRate, smoothingSeconds);
+        peakGain.reset(sampleRate, smoothingSeconds);
+        peakQuality.reset(sampleRate, smoothingSeconds);
+
+        //switching a band in or out blends it with the dry signal instead
+        lowCut.mix.reset(sampleRate, bandFadeSeconds);
+        highCut.mix.reset(sampleRate, bandFadeSeconds);
+        peak.mix.reset(sampleRate, bandFadeSeconds);
+
+        //and a new slope is crossfaded in from the old one
+        lowCut.slopeFade.reset(sampleRate, bandFadeSeconds);
+        highCut.slopeFade.reset(sampleRate, bandFadeSeconds);
+
+        updateCoefficients();
+    }
+
+    //clears the integrators and jumps every parameter to its target
+    void reset()
+    {
+        for (auto& channel : states)
+            channel = {};
+
+        lowCutFreq.setCurrentAndTargetValue(lowCutFreq.getTargetValue());
+        highCutFreq.setCurrentAndTargetValue(highCutFreq.getTargetValue());
+        peakFreq.setCurrentAndTargetValue(peakFreq.getTargetValue());
+        peakGain.setCurrentAndTargetValue(peakGain.getTargetValue());
+        peakQuality.setCurrentAndTargetValue(peakQuality.getTargetValue());
+
+        lowCut.mix.setCurrentAndTargetValue(lowCut.mix.getTargetValue());
+        highCut.mix.setCurrentAndTargetValue(highCut.mix.getTargetValue());
+        peak.mix.setCurrentAndTargetValue(peak.mix.getTargetValue());
+        lowCut.running = lowCut.wanted;
+        highCut.running = highCut.wanted;
+        peak.running = peak.wanted;
+
+        finishSlopeFade(lowCut);
+        finishSlopeFade(highCut);
+
+        updateCoefficients();
+    }
+
+    //inverseQ is the butterworth 1/Q of each section, only the first numSections are used
+    void setLowCut(float frequency, const std::array<double, maxCutSections>& inverseQ, int numSections, bool isActive)
+    {
+        lowCutFreq.setTargetValue(frequency);
+        setCut(lowCut, inverseQ, numSections, isActive);
+    }
+
+    void setHighCut(float frequency, const std::array<double, maxCutSections>& inverseQ, int numSections, bool isActive)
+    {
+        highCutFreq.setTargetValue(frequency);
+        setCut(highCut, inverseQ, numSections, isActive);
+    }
+
+    void setPeak(float frequency, float gainInDecibels, float quality, bool isActive)
+    {
+        peakFreq.setTargetValue(frequency);
+        peakGain.setTargetValue(gainInDecibels);
+        peakQuality.setTargetValue(quality);
+
+        if (isActive && !peak.running)
+            resetBand(peakIndex, 1);
+
+        peak.wanted = isActive;
+        peak.mix.setTargetValue(isActive ? 1.f : 0.f);
+    }
+
+    void process(const juce::dsp::ProcessContextReplacing<float>& context)
+    {
+        auto& block = context.getOutputBlock();
+        const auto channelsToProcess = juce::jmin((int)block.getNumChannels(), numChannels);
+        const auto numSamples = (int)block.getNumSamples();
+
+        if (context.isBypassed)
+            return;
+
+        //a band that's been switched off fades out into the dry signal, and only drops out once it's gone
+        lowCut.running = lowCut.wanted || lowCut.mix.isSmoothing();
+        highCut.running = highCut.wanted || highCut.mix.isSmoothing();
+        peak.running = peak.wanted || peak.mix.isSmoothing();
+
+        //a slope fade that's done hands over to a change that was waiting for it
+        for (auto* band : { &lowCut, &highCut })
+        {
+            if (band->slopeFading && !band->slopeFade.isSmoothing())
+            {
+                band->slopeFading = false;
+
+                if (band->hasPendingSlope)
+                    startSlopeFade(*band, band->pendingInverseQ, band->pendingNumSections);
+            }
+        }
+
+        if (!lowCut.running && !highCut.running && !peak.running)
+            return;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            if (isSmoothing())
+            {
+                lowCutFreq.getNextValue();
+                highCutFreq.getNextValue();
+                peakFreq.getNextValue();
+                peakGain.getNextValue();
+                peakQuality.getNextValue();
+
+                updateCoefficients();
+            }
+
+            const auto lowCutMix = lowCut.mix.getNextValue();
+            const auto peakMix = peak.mix.getNextValue();
+            const auto highCutMix = highCut.mix.getNextValue();
+            const auto lowCutSlopeFade = lowCut.slopeFade.getNextValue();
+            const auto highCutSlopeFade = highCut.slopeFade.getNextValue();
+
+            for (int ch = 0; ch < channelsToProcess; ++ch)
+            {
+                auto* data = block.getChannelPointer((size_t)ch);
+                auto& channelStates = states[(size_t)ch];
+                auto x = data[i];
+
+                if (lowCut.running)
+                    x += lowCutMix * (processCut(lowCut, channelStates, x, lowCutSlopeFade) - x);
+
+                if (peak.running)
+                    x += peakMix * (processSvf(sections[peakIndex], channelStates[peakIndex], x) - x);
+
+                if (highCut.running)
+                    x += highCutMix * (processCut(highCut, channelStates, x, highCutSlopeFade) - x);
+
+                data[i] = x;
+            }
+        }
+    }
+
+private:
+    static constexpr double smoothingSeconds = 0.02;
+    static constexpr double bandFadeSeconds = 0.005;
+    //the cut bands' old sections run on in their own slots while a slope change fades over
+    static constexpr int lowCutIndex = 0, peakIndex = 4, highCutIndex = 5;
+    static constexpr int lowCutFadingOutIndex = 9, highCutFadingOutIndex = 13, numSections = 17;
+
+    struct CutBand
+    {
+        CutBand(int first, int firstFadingOut) : firstSection(first), firstFadingOutSection(firstFadingOut) {}
+
+        const int firstSection, firstFadingOutSection;
+        std::array<double, maxCutSections> inverseQ{};
+        int numSections = 1;
+        bool wanted = false, running = false;
+        //how much of the band's output is used, the rest is the dry signal. 1 while it's on
+        juce::SmoothedValue<float> mix{ 0.f };
+
+        //a slope change keeps the old sections going on a copy of their state while the new ones fade in.
+        //one that comes in mid-fade waits for it to finish, only the newest is kept
+        std::array<double, maxCutSections> fadingOutInverseQ{}, pendingInverseQ{};
+        int fadingOutNumSections = 0, pendingNumSections = 1;
+        bool slopeFading = false, hasPendingSlope = false;
+        juce::SmoothedValue<float> slopeFade{ 1.f };
+    };
+
+    struct PeakBand
+    {
+        bool wanted = false, running = false;
+        juce::SmoothedValue<float> mix{ 0.f };
+    };
+
+    double sampleRate = 44100.0;
+    int numChannels = 0;
+
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> lowCutFreq{ 20.f }, highCutFreq{ 20000.f }, peakFreq{ 750.f };
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Linear> peakGain{ 0.f }, peakQuality{ 1.f };
+
+    CutBand lowCut{ lowCutIndex, lowCutFadingOutIndex }, highCut{ highCutIndex, highCutFadingOutIndex };
+    PeakBand peak;
+
+    std::array<SvfCoefficients, numSections> sections;
+    std::vector<std::array<SvfState, numSections>> states;
+
+    bool isSmoothing() const
+    {
+        return lowCutFreq.isSmoothing() || highCutFreq.isSmoothing() || peakFreq.isSmoothing()
+            || peakGain.isSmoothing() || peakQuality.isSmoothing();
+    }
+
+    void setCut(CutBand& band, const std::array<double, maxCutSections>& inverseQ, int newNumSections, bool isActive)
+    {
+        newNumSections = juce::jlimit(1, maxCutSections, newNumSections);
+        const auto slopeChanged = newNumSections != band.numSections || inverseQ != band.inverseQ;
+
+        if (!band.running)
+        {
+            //nobody hears it, so the slope just changes. a band coming in starts from rest and the mix fades it in
+            if (isActive)
+                resetBand(band.firstSection, maxCutSections);
+
+            band.inverseQ = inverseQ;
+            band.numSections = newNumSections;
+            finishSlopeFade(band);
+        }
+        else if (band.slopeFading)
+        {
+            band.pendingInverseQ = inverseQ;
+            band.pendingNumSections = newNumSections;
+            band.hasPendingSlope = slopeChanged;
+        }
+        else if (slopeChanged)
+        {
+            startSlopeFade(band, inverseQ, newNumSections);
+        }
+
+        band.wanted = isActive;
+        band.mix.setTargetValue(isActive ? 1.f : 0.f);
+
+        updateCoefficients();
+    }
+
+    void startSlopeFade(CutBand& band, const std::array<double, maxCutSections>& inverseQ, int newNumSections)
+    {
+        //the old sections carry on from where they are
+        for (auto& channel : states)
+            std::copy(channel.begin() + band.firstSection, channel.begin() + band.firstSection + maxCutSections,
+                channel.begin() + band.firstFadingOutSection);
+
+        band.fadingOutInverseQ = band.inverseQ;
+        band.fadingOutNumSections = band.numSections;
+
+        //the ones that were running keep their state under the new Q, any extra ones start from rest
+        if (newNumSections > band.numSections)
+            resetBand(band.firstSection + band.numSections, newNumSections - band.numSections);
+
+        band.inverseQ = inverseQ;
+        band.numSections = newNumSections;
+        band.hasPendingSlope = false;
+        band.slopeFading = true;
+        band.slopeFade.setCurrentAndTargetValue(0.f);
+        band.slopeFade.setTargetValue(1.f);
+
+        updateCoefficients();
+    }
+
+    //drops any fade, a waiting slope takes over straight away
+    void finishSlopeFade(CutBand& band)
+    {
+        if (band.hasPendingSlope)
+        {
+            band.inverseQ = band.pendingInverseQ;
+            band.numSections = band.pendingNumSections;
+            band.hasPendingSlope = false;
+        }
+
+        band.slopeFading = false;
+        band.slopeFade.setCurrentAndTargetValue(1.f);
+    }
+
+    //the band's sections in series, blended from the old ones while a slope change is fading
+    float processCut(const CutBand& band, std::array<SvfState, numSections>& channelStates, float x, float slopeFade) const
+    {
+        auto y = x;
+        for (int s = band.firstSection; s < band.firstSection + band.numSections; ++s)
+            y = processSvf(sections[(size_t)s], channelStates[(size_t)s], y);
+
+        if (!band.slopeFading)
+            return y;
+
+        auto old = x;
+        for (int s = band.firstFadingOutSection; s < band.firstFadingOutSection + band.fadingOutNumSections; ++s)
+            old = processSvf(sections[(size_t)s], channelStates[(size_t)s], old);
+
+        return old + slopeFade * (y - old);
+    }
+
+    void resetBand(int firstSection, int count)
+    {
+        for (auto& channel : states)
+            for (int s = firstSection; s < firstSection + count; ++s)
+                channel[(size_t)s] = {};
+    }
+
+    float prewarp(float frequency) const
+    {
+        const auto normalisedFreq = juce::jlimit(1.0e-5, 0.499, frequency / sampleRate);
+        return (float)std::tan(juce::MathConstants<double>::pi * normalisedFreq);
+    }
+
+    //three tan()s and a handful of divides for the whole chain, the sections fading out share their band's g
+    void updateCoefficients()
+    {
+        const auto gLow = prewarp(lowCutFreq.getCurrentValue());
+        for (int s = 0; s < maxCutSections; ++s)
+        {
+            const auto k = (float)lowCut.inverseQ[(size_t)s];
+            sections[(size_t)(lowCutIndex + s)] = makeSvf(gLow, k, 1.f, -k, -1.f);
+
+            const auto kOld = (float)lowCut.fadingOutInverseQ[(size_t)s];
+            sections[(size_t)(lowCutFadingOutIndex + s)] = makeSvf(gLow, kOld, 1.f, -kOld, -1.f);
+        }
+
+        const auto gHigh = prewarp(highCutFreq.getCurrentValue());
+        for (int s = 0; s < maxCutSections; ++s)
+        {
+            const auto k = (float)highCut.inverseQ[(size_t)s];
+            sections[(size_t)(highCutIndex + s)] = makeSvf(gHigh, k, 0.f, 0.f, 1.f);
+
+            const auto kOld = (float)highCut.fadingOutInverseQ[(size_t)s];
+            sections[(size_t)(highCutFadingOutIndex + s)] = makeSvf(gHigh, kOld, 0.f, 0.f, 1.f);
+        }
+
+        //bell: k = 1 / (Q * A), band output weighted by k * (A^2 - 1), A = 10^(dB / 40)
+        const auto A = std::pow(10.f, peakGain.getCurrentValue() / 40.f);
+        const auto k = 1.f / (peakQuality.getCurrentValue() * A);
+        sections[peakIndex] = makeSvf(prewarp(peakFreq.getCurrentValue()), k, 1.f, k * (A * A - 1.f), 0.f);
+    }
+};